@@ -0,0 +1,343 @@
+/*
+ * Copyright 2002 - Florian Schulze <crow@icculus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * This file is part of vt.
+ *
+ */
+
+
+#include <stdlib.h>
+#include <math.h>
+#ifdef _WIN32
+# include <windows.h>
+#else
+# include <sys/time.h>
+#endif
+#include "SDL.h"
+#include "dyngl.h"
+#include "vt_level.h"
+#include "glmath.h"
+#include "bench.h"
+
+#define RCSID "$Id$"
+
+/** \brief reads a camera path.
+  *
+  * One key per line: x y z [yaw pitch roll], empty lines and lines starting with # are
+  * skipped. Returns false if the file can't be read or has no keys.
+  */
+bool bench_load_path(const char *filename, bench_key_array_t & keys)
+{
+	FILE *f;
+	char line[256];
+
+	if ((f = fopen(filename, "r")) == NULL)
+		return false;
+
+	keys.resize(0);
+	while (fgets(line, sizeof(line), f)) {
+		bench_key_t key;
+
+		if (sscanf(line, " %f %f %f %f %f %f", &key.pos.x, &key.pos.y, &key.pos.z, &key.angles.yaw, &key.angles.pitch, &key.angles.roll) < 3)
+			continue;	// comment or empty line
+		keys.resize(keys.size() + 1, key);
+	}
+	fclose(f);
+
+	return !keys.empty();
+}
+
+/// \brief sets yaw and pitch so the camera looks along dir.
+static void look_along(const vec3_t & dir, ang3_t & angles)
+{
+	angles.yaw = (float)atan2(-dir.x, -dir.z) * (180.0f / F_PI);
+	angles.pitch = (float)atan2(dir.y, sqrt(dir.x * dir.x + dir.z * dir.z)) * (180.0f / F_PI);
+}
+
+/** \brief builds a camera path through the centres of all rooms.
+  *
+  * Every key looks towards the next one. Used when no path file is given, so every level
+  * has a benchmark.
+  */
+void bench_room_path(VT_Level & level, bench_key_array_t & keys)
+{
+	bitu32 i, count = 0;
+
+	keys.resize(0);
+	keys.resize(level.rooms.size());
+	for (i = 0; i < level.rooms.size(); i++) {
+		vt_room_vertices_t &rv = level.room_vertices[i];
+
+		if (rv.num_vertices == 0)
+			continue;
+		keys[count].pos.x = level.rooms[i].offset.x + (rv.bbox_min.x + rv.bbox_max.x) * 0.5f;
+		keys[count].pos.y = (rv.bbox_min.y + rv.bbox_max.y) * 0.5f;
+		keys[count].pos.z = level.rooms[i].offset.z + (rv.bbox_min.z + rv.bbox_max.z) * 0.5f;
+		count++;
+	}
+	keys.resize(count);
+
+	for (i = 0; i < count; i++) {
+		vec3_t dir;
+
+		if (i + 1 < count)
+			dir = keys[i + 1].pos - keys[i].pos;
+		else if (i > 0)
+			dir = keys[i].pos - keys[i - 1].pos;
+		else
+			continue;
+		dir.y = 0.0f;
+		look_along(dir, keys[i].angles);
+	}
+}
+
+/// \brief returns the flyby sequences of the level in ascending order.
+void bench_flyby_sequences(VT_Level & level, bitu32_array_t & sequences)
+{
+	bool used[256];
+	bitu32 i, count = 0;
+
+	for (i = 0; i < 256; i++)
+		used[i] = false;
+	for (i = 0; i < level.flyby_cameras.size(); i++)
+		used[level.flyby_cameras[i].sequence] = true;
+
+	sequences.resize(0);
+	sequences.resize(256);
+	for (i = 0; i < 256; i++)
+		if (used[i])
+			sequences[count++] = i;
+	sequences.resize(count);
+}
+
+/** \brief builds the camera path of a flyby sequence.
+  *
+  * One key per flyby camera of the sequence, ordered by index, looking at the camera target.
+  * The timer, speed and fov of the cameras are not used. Returns false if the sequence has
+  * no cameras.
+  */
+bool bench_flyby_path(VT_Level & level, bitu32 sequence, bench_key_array_t & keys)
+{
+	bitu32_array_t order(level.flyby_cameras.size());
+	bitu32 i, j, count = 0;
+
+	// insertion sort by index, sequences are short
+	for (i = 0; i < level.flyby_cameras.size(); i++) {
+		if (level.flyby_cameras[i].sequence != sequence)
+			continue;
+		for (j = count; (j > 0) && (level.flyby_cameras[order[j - 1]].index > level.flyby_cameras[i].index); j--)
+			order[j] = order[j - 1];
+		order[j] = i;
+		count++;
+	}
+
+	keys.resize(0);
+	keys.resize(count);
+	for (i = 0; i < count; i++) {
+		tr4_flyby_camera_t &camera = level.flyby_cameras[order[i]];
+
+		keys[i].pos = camera.pos;
+		look_along(camera.target - camera.pos, keys[i].angles);
+		keys[i].angles.roll = camera.roll * (90.0f / 16384.0f);
+	}
+
+	return count > 0;
+}
+
+/// \brief Catmull-Rom interpolation between b and c.
+static float catmull_rom(float a, float b, float c, float d, float t)
+{
+	return 0.5f * ((2.0f * b) + (c - a) * t + (2.0f * a - 5.0f * b + 4.0f * c - d) * t * t + (3.0f * (b - c) + d - a) * t * t * t);
+}
+
+/// \brief returns angle plus a multiple of 360 degrees, so it is closest to reference.
+static float unwrap_angle(float angle, float reference)
+{
+	return angle - 360.0f * (float)floor((angle - reference) / 360.0f + 0.5f);
+}
+
+/** \brief samples a camera path.
+  *
+  * The camera passes through the keys on a Catmull-Rom spline, key i is reached at t = i.
+  * t is clamped to 0 .. keys.size() - 1. Angles take the shorter way around. keys must not
+  * be empty.
+  */
+void bench_sample_path(bench_key_array_t & keys, float t, bench_key_t & out)
+{
+	bitu32 n = keys.size();
+	bitu32 seg, i;
+	bench_key_t *k[4];
+
+	if (n < 2) {
+		out = keys[0];
+		return;
+	}
+	if (t < 0.0f)
+		t = 0.0f;
+	seg = (bitu32)t;
+	if (seg > n - 2)
+		seg = n - 2;
+	t -= (float)seg;
+	if (t > 1.0f)
+		t = 1.0f;
+
+	k[0] = &keys[seg > 0 ? seg - 1 : 0];
+	k[1] = &keys[seg];
+	k[2] = &keys[seg + 1];
+	k[3] = &keys[seg + 2 < n ? seg + 2 : n - 1];
+
+	out.pos.x = catmull_rom(k[0]->pos.x, k[1]->pos.x, k[2]->pos.x, k[3]->pos.x, t);
+	out.pos.y = catmull_rom(k[0]->pos.y, k[1]->pos.y, k[2]->pos.y, k[3]->pos.y, t);
+	out.pos.z = catmull_rom(k[0]->pos.z, k[1]->pos.z, k[2]->pos.z, k[3]->pos.z, t);
+	for (i = 0; i < 3; i++) {
+		float a, b, c, d;
+
+		b = k[1]->angles[i];
+		a = unwrap_angle(k[0]->angles[i], b);
+		c = unwrap_angle(k[2]->angles[i], b);
+		d = unwrap_angle(k[3]->angles[i], c);
+		out.angles[i] = catmull_rom(a, b, c, d, t);
+	}
+}
+
+/// \brief returns a timestamp in milliseconds with sub-millisecond resolution.
+double bench_time()
+{
+#ifdef _WIN32
+	LARGE_INTEGER count, frequency;
+
+	QueryPerformanceCounter(&count);
+	QueryPerformanceFrequency(&frequency);
+	return (double)count.QuadPart * 1000.0 / (double)frequency.QuadPart;
+#else
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (double)tv.tv_sec * 1000.0 + (double)tv.tv_usec / 1000.0;
+#endif
+}
+
+/** \brief FNV-1a hash of data.
+  *
+  * Start with BENCH_CHECKSUM_INIT, pass the result back in to hash more data.
+  */
+bitu32 bench_checksum(bitu32 hash, const bitu8 *data, bitu32 size)
+{
+	bitu32 i;
+
+	for (i = 0; i < size; i++) {
+		hash ^= data[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+#define OSMESA_RGBA GL_RGBA
+
+typedef void *(DYNGLENTRY * osmesa_create_context_ext_t) (GLenum format, GLint depth_bits, GLint stencil_bits, GLint accum_bits, void *sharelist);
+typedef GLboolean(DYNGLENTRY * osmesa_make_current_t) (void *context, void *buffer, GLenum type, GLsizei width, GLsizei height);
+typedef void (DYNGLENTRY * osmesa_destroy_context_t) (void *context);
+typedef void *(DYNGLENTRY * osmesa_get_proc_address_t) (const char *name);
+
+static const char *osmesa_names[] = {
+#ifdef _WIN32
+	"osmesa.dll",
+#else
+	"libOSMesa.so.8",
+	"libOSMesa.so.6",
+	"libOSMesa.so",
+#endif
+	NULL
+};
+
+static void *osmesa_library = NULL;
+static void *osmesa_context = NULL;
+static bitu8 *osmesa_buffer = NULL;
+static osmesa_destroy_context_t pOSMesaDestroyContext;
+static osmesa_get_proc_address_t pOSMesaGetProcAddress;
+
+/// \brief looks up a GL function, OSMesa exports the core functions directly.
+static void *osmesa_getproc(const char *name)
+{
+	void *proc;
+
+	if ((proc = SDL_LoadFunction(osmesa_library, name)) == NULL)
+		proc = pOSMesaGetProcAddress(name);
+	return proc;
+}
+
+/** \brief creates an offscreen OpenGL context with OSMesa and makes it current.
+  *
+  * The context renders into memory, so no window or GPU is needed. The GL functions are
+  * loaded through DynGL_LoadProcAddress, call DynGL_GetFunctions afterwards. Returns false
+  * and sets the SDL error if OSMesa is not available.
+  */
+bool bench_create_offscreen(int width, int height)
+{
+	osmesa_create_context_ext_t pOSMesaCreateContextExt;
+	osmesa_make_current_t pOSMesaMakeCurrent;
+	int i;
+
+	for (i = 0; (osmesa_library == NULL) && (osmesa_names[i] != NULL); i++)
+		osmesa_library = SDL_LoadObject(osmesa_names[i]);
+	if (osmesa_library == NULL) {
+		SDL_SetError("bench_create_offscreen: can't load OSMesa");
+		return false;
+	}
+
+	pOSMesaCreateContextExt = (osmesa_create_context_ext_t)SDL_LoadFunction(osmesa_library, "OSMesaCreateContextExt");
+	pOSMesaMakeCurrent = (osmesa_make_current_t)SDL_LoadFunction(osmesa_library, "OSMesaMakeCurrent");
+	pOSMesaDestroyContext = (osmesa_destroy_context_t)SDL_LoadFunction(osmesa_library, "OSMesaDestroyContext");
+	pOSMesaGetProcAddress = (osmesa_get_proc_address_t)SDL_LoadFunction(osmesa_library, "OSMesaGetProcAddress");
+	if (!pOSMesaCreateContextExt || !pOSMesaMakeCurrent || !pOSMesaDestroyContext || !pOSMesaGetProcAddress) {
+		SDL_SetError("bench_create_offscreen: OSMesa functions missing");
+		bench_destroy_offscreen();
+		return false;
+	}
+
+	if ((osmesa_context = pOSMesaCreateContextExt(OSMESA_RGBA, 24, 0, 0, NULL)) == NULL) {
+		SDL_SetError("bench_create_offscreen: OSMesaCreateContextExt failed");
+		bench_destroy_offscreen();
+		return false;
+	}
+	osmesa_buffer = new bitu8[width * height * 4];
+	if (!pOSMesaMakeCurrent(osmesa_context, osmesa_buffer, GL_UNSIGNED_BYTE, width, height)) {
+		SDL_SetError("bench_create_offscreen: OSMesaMakeCurrent failed");
+		bench_destroy_offscreen();
+		return false;
+	}
+
+	if (DynGL_LoadProcAddress(osmesa_getproc) == SDL_FALSE) {
+		bench_destroy_offscreen();
+		return false;
+	}
+
+	return true;
+}
+
+/// \brief destroys the context of bench_create_offscreen, call DynGL_CloseLibrary first.
+void bench_destroy_offscreen()
+{
+	if (osmesa_context)
+		pOSMesaDestroyContext(osmesa_context);
+	osmesa_context = NULL;
+	delete [] osmesa_buffer;
+	osmesa_buffer = NULL;
+	if (osmesa_library)
+		SDL_UnloadObject(osmesa_library);
+	osmesa_library = NULL;
+}
@@ -0,0 +1,25 @@
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+/// \brief Camera key of a benchmark path.
+typedef struct {
+	vec3_t pos;		///< \brief camera position in level coordinates.
+	ang3_t angles;		///< \brief camera angles in degrees.
+} bench_key_t;
+typedef prtl::array < bench_key_t > bench_key_array_t;
+
+bool bench_load_path(const char *filename, bench_key_array_t & keys);
+void bench_room_path(VT_Level & level, bench_key_array_t & keys);
+void bench_flyby_sequences(VT_Level & level, bitu32_array_t & sequences);
+bool bench_flyby_path(VT_Level & level, bitu32 sequence, bench_key_array_t & keys);
+void bench_sample_path(bench_key_array_t & keys, float t, bench_key_t & out);
+
+#define BENCH_CHECKSUM_INIT 2166136261u	///< \brief start value of bench_checksum().
+
+double bench_time();
+bitu32 bench_checksum(bitu32 hash, const bitu8 *data, bitu32 size);
+
+bool bench_create_offscreen(int width, int height);
+void bench_destroy_offscreen();
+
+#endif // _BENCH_H_
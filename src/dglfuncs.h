@@ -67,6 +67,7 @@ DYNGL_NEED (void, glColor4ubv, (const GLubyte * v))
 DYNGL_NEED (void, glColor4ub, (GLubyte red, GLubyte green, GLubyte blue, GLubyte alpha))
 DYNGL_NEED (void, glColor4fv, (const GLfloat * v))
 DYNGL_NEED (void, glColorPointer, (GLint size, GLenum type, GLsizei stride, const GLvoid * ptr))
+DYNGL_EXT (void, glCompressedTexImage2DARB, (GLenum target, GLint level, GLenum internalformat, GLsizei width, GLsizei height, GLint border, GLsizei imageSize, const GLvoid * data), "GL_ARB_texture_compression")
 DYNGL_NEED (void, glCullFace, (GLenum mode))
 DYNGL_NEED (void, glDeleteTextures, (GLsizei, const GLuint *))
 DYNGL_NEED (void, glDepthFunc, (GLenum func))
@@ -105,6 +106,7 @@ DYNGL_NEED (void, glScalef, (GLfloat x, GLfloat y, GLfloat z))
 DYNGL_EXT (void, glSecondaryColorPointerEXT, (GLint size, GLenum type, GLsizei stride, const GLvoid * pointer), "GL_EXT_secondary_color")
 DYNGL_NEED (void, glTexCoordPointer, (GLint size, GLenum type, GLsizei stride, const GLvoid * ptr))
 DYNGL_NEED (void, glTexCoord2f, (GLfloat x, GLfloat y))
+DYNGL_NEED (void, glTexCoord2fv, (const GLfloat * v))
 DYNGL_NEED (void, glTexEnvi, (GLenum target, GLenum pname, GLint param))
 DYNGL_NEED (void, glTexImage2D, (GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const GLvoid * pixels))
 DYNGL_NEED (void, glTexParameterf, (GLenum target, GLenum pname, GLfloat param))
@@ -59,6 +59,314 @@ DYNGLCALL void DYNGLENTRY Alt_glDrawRangeElements(GLenum mode, GLuint start, GLu
 
 /* Internal flag for shutting things down properly */
 static SDL_bool dyngl_loaded = SDL_FALSE;
+static void *(*dyngl_getproc) (const char *name) = NULL;
+
+
+/*
+ * Counting wrappers
+ *
+ * DynGL_SetCounting () swaps the function pointers of the drawing and texture
+ * binding functions for these wrappers.  They count into dyngl_counters and
+ * call the driver's function, which is kept in dyngl_real.  Only the
+ * functions which submit geometry or switch textures are wrapped, so the
+ * other calls do not pay for it.
+ */
+dyngl_counters_t dyngl_counters;
+
+static SDL_bool dyngl_counting = SDL_FALSE;
+
+static struct {
+	void (DYNGLENTRY * glBegin) (GLenum mode);
+	void (DYNGLENTRY * glBindTexture) (GLenum target, GLuint texture);
+	void (DYNGLENTRY * glDrawArrays) (GLenum mode, GLint first, GLsizei count);
+	void (DYNGLENTRY * glDrawElements) (GLenum mode, GLsizei count, GLenum type, const GLvoid * indices);
+	void (DYNGLENTRY * glDrawRangeElements) (GLenum, GLuint, GLuint, GLsizei, GLenum, const GLvoid *);
+	void (DYNGLENTRY * glDrawRangeElementsEXT) (GLenum, GLuint, GLuint, GLsizei, GLenum, const GLvoid *);
+	void (DYNGLENTRY * glVertex2f) (GLfloat x, GLfloat y);
+	void (DYNGLENTRY * glVertex3f) (GLfloat x, GLfloat y, GLfloat z);
+	void (DYNGLENTRY * glVertex3fv) (const GLfloat * v);
+} dyngl_real;
+
+static void DYNGLENTRY Count_glBegin(GLenum mode)
+{
+	dyngl_counters.draw_calls++;
+	dyngl_real.glBegin(mode);
+}
+
+static void DYNGLENTRY Count_glBindTexture(GLenum target, GLuint texture)
+{
+	dyngl_counters.texture_binds++;
+	dyngl_real.glBindTexture(target, texture);
+}
+
+static void DYNGLENTRY Count_glDrawArrays(GLenum mode, GLint first, GLsizei count)
+{
+	dyngl_counters.draw_calls++;
+	dyngl_counters.vertices += count;
+	dyngl_real.glDrawArrays(mode, first, count);
+}
+
+static void DYNGLENTRY Count_glDrawElements(GLenum mode, GLsizei count, GLenum type, const GLvoid * indices)
+{
+	dyngl_counters.draw_calls++;
+	dyngl_counters.vertices += count;
+	dyngl_real.glDrawElements(mode, count, type, indices);
+}
+
+static void DYNGLENTRY Count_glDrawRangeElements(GLenum mode, GLuint start, GLuint end, GLsizei count, GLenum type, const GLvoid * indices)
+{
+	dyngl_counters.draw_calls++;
+	dyngl_counters.vertices += count;
+	dyngl_real.glDrawRangeElements(mode, start, end, count, type, indices);
+}
+
+static void DYNGLENTRY Count_glDrawRangeElementsEXT(GLenum mode, GLuint start, GLuint end, GLsizei count, GLenum type, const GLvoid * indices)
+{
+	dyngl_counters.draw_calls++;
+	dyngl_counters.vertices += count;
+	dyngl_real.glDrawRangeElementsEXT(mode, start, end, count, type, indices);
+}
+
+static void DYNGLENTRY Count_glVertex2f(GLfloat x, GLfloat y)
+{
+	dyngl_counters.vertices++;
+	dyngl_real.glVertex2f(x, y);
+}
+
+static void DYNGLENTRY Count_glVertex3f(GLfloat x, GLfloat y, GLfloat z)
+{
+	dyngl_counters.vertices++;
+	dyngl_real.glVertex3f(x, y, z);
+}
+
+static void DYNGLENTRY Count_glVertex3fv(const GLfloat * v)
+{
+	dyngl_counters.vertices++;
+	dyngl_real.glVertex3fv(v);
+}
+
+
+/*
+ * State cache
+ *
+ * DynGL_SetStateCache () swaps the function pointers of some state changes
+ * for wrappers which remember the state and drop calls that would set it to
+ * what it already is.  Tracked are the texture bound to GL_TEXTURE_2D, the
+ * glEnable bits, the blend function, the matrix mode and the current colour.
+ * Everything starts out unknown, so the first call always gets through.
+ *
+ * The current colour is undefined after drawing with a colour array, so
+ * every glDraw* call forgets it.  Deleting the bound texture and switching
+ * the texture unit forget the binding.  The functions called are the ones
+ * in qgl* when the cache was turned on, kept in dyngl_cached, so the cache
+ * works on top of the counting wrappers.
+ */
+#define DYNGL_MAX_CAPS 32
+
+static SDL_bool dyngl_caching = SDL_FALSE;
+
+static struct {
+	void (DYNGLENTRY * glActiveTextureARB) (GLenum);
+	void (DYNGLENTRY * glBindTexture) (GLenum target, GLuint texture);
+	void (DYNGLENTRY * glBlendFunc) (GLenum sfactor, GLenum dfactor);
+	void (DYNGLENTRY * glColor3f) (GLfloat red, GLfloat green, GLfloat blue);
+	void (DYNGLENTRY * glColor3ub) (GLubyte red, GLubyte green, GLubyte blue);
+	void (DYNGLENTRY * glColor3ubv) (const GLubyte * v);
+	void (DYNGLENTRY * glColor4f) (GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha);
+	void (DYNGLENTRY * glColor4fv) (const GLfloat * v);
+	void (DYNGLENTRY * glColor4ub) (GLubyte red, GLubyte green, GLubyte blue, GLubyte alpha);
+	void (DYNGLENTRY * glColor4ubv) (const GLubyte * v);
+	void (DYNGLENTRY * glDeleteTextures) (GLsizei, const GLuint *);
+	void (DYNGLENTRY * glDisable) (GLenum cap);
+	void (DYNGLENTRY * glDrawArrays) (GLenum mode, GLint first, GLsizei count);
+	void (DYNGLENTRY * glDrawElements) (GLenum mode, GLsizei count, GLenum type, const GLvoid * indices);
+	void (DYNGLENTRY * glDrawRangeElements) (GLenum, GLuint, GLuint, GLsizei, GLenum, const GLvoid *);
+	void (DYNGLENTRY * glDrawRangeElementsEXT) (GLenum, GLuint, GLuint, GLsizei, GLenum, const GLvoid *);
+	void (DYNGLENTRY * glEnable) (GLenum cap);
+	void (DYNGLENTRY * glMatrixMode) (GLenum mode);
+} dyngl_cached;
+
+static struct {
+	SDL_bool texture_known;
+	GLuint texture;
+	SDL_bool blend_known;
+	GLenum blend_src, blend_dst;
+	SDL_bool matrix_mode_known;
+	GLenum matrix_mode;
+	SDL_bool colour_known;
+	GLfloat colour[4];
+	int num_caps;
+	GLenum caps[DYNGL_MAX_CAPS];
+	GLboolean cap_enabled[DYNGL_MAX_CAPS];
+} dyngl_state;
+
+/* Sets the current colour unless it is already set, returns SDL_FALSE if the call can be dropped */
+static SDL_bool dyngl_set_colour(GLfloat r, GLfloat g, GLfloat b, GLfloat a)
+{
+	if (dyngl_state.colour_known && (dyngl_state.colour[0] == r) && (dyngl_state.colour[1] == g) &&
+		(dyngl_state.colour[2] == b) && (dyngl_state.colour[3] == a)) {
+		dyngl_counters.state_elided++;
+		return SDL_FALSE;
+	}
+	dyngl_state.colour_known = SDL_TRUE;
+	dyngl_state.colour[0] = r;
+	dyngl_state.colour[1] = g;
+	dyngl_state.colour[2] = b;
+	dyngl_state.colour[3] = a;
+	return SDL_TRUE;
+}
+
+/* Same for glEnable and glDisable, caps beyond DYNGL_MAX_CAPS always get through */
+static SDL_bool dyngl_set_cap(GLenum cap, GLboolean enabled)
+{
+	int i;
+
+	for (i = 0; i < dyngl_state.num_caps; i++)
+		if (dyngl_state.caps[i] == cap) {
+			if (dyngl_state.cap_enabled[i] == enabled) {
+				dyngl_counters.state_elided++;
+				return SDL_FALSE;
+			}
+			dyngl_state.cap_enabled[i] = enabled;
+			return SDL_TRUE;
+		}
+	if (dyngl_state.num_caps < DYNGL_MAX_CAPS) {
+		dyngl_state.caps[dyngl_state.num_caps] = cap;
+		dyngl_state.cap_enabled[dyngl_state.num_caps] = enabled;
+		dyngl_state.num_caps++;
+	}
+	return SDL_TRUE;
+}
+
+static void DYNGLENTRY Cache_glActiveTextureARB(GLenum texture)
+{
+	dyngl_state.texture_known = SDL_FALSE;
+	dyngl_cached.glActiveTextureARB(texture);
+}
+
+static void DYNGLENTRY Cache_glBindTexture(GLenum target, GLuint texture)
+{
+	if (target == GL_TEXTURE_2D) {
+		if (dyngl_state.texture_known && (dyngl_state.texture == texture)) {
+			dyngl_counters.state_elided++;
+			return;
+		}
+		dyngl_state.texture_known = SDL_TRUE;
+		dyngl_state.texture = texture;
+	}
+	dyngl_cached.glBindTexture(target, texture);
+}
+
+static void DYNGLENTRY Cache_glBlendFunc(GLenum sfactor, GLenum dfactor)
+{
+	if (dyngl_state.blend_known && (dyngl_state.blend_src == sfactor) && (dyngl_state.blend_dst == dfactor)) {
+		dyngl_counters.state_elided++;
+		return;
+	}
+	dyngl_state.blend_known = SDL_TRUE;
+	dyngl_state.blend_src = sfactor;
+	dyngl_state.blend_dst = dfactor;
+	dyngl_cached.glBlendFunc(sfactor, dfactor);
+}
+
+static void DYNGLENTRY Cache_glColor3f(GLfloat red, GLfloat green, GLfloat blue)
+{
+	if (dyngl_set_colour(red, green, blue, 1.0f))
+		dyngl_cached.glColor3f(red, green, blue);
+}
+
+static void DYNGLENTRY Cache_glColor3ub(GLubyte red, GLubyte green, GLubyte blue)
+{
+	if (dyngl_set_colour(red / 255.0f, green / 255.0f, blue / 255.0f, 1.0f))
+		dyngl_cached.glColor3ub(red, green, blue);
+}
+
+static void DYNGLENTRY Cache_glColor3ubv(const GLubyte * v)
+{
+	if (dyngl_set_colour(v[0] / 255.0f, v[1] / 255.0f, v[2] / 255.0f, 1.0f))
+		dyngl_cached.glColor3ubv(v);
+}
+
+static void DYNGLENTRY Cache_glColor4f(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha)
+{
+	if (dyngl_set_colour(red, green, blue, alpha))
+		dyngl_cached.glColor4f(red, green, blue, alpha);
+}
+
+static void DYNGLENTRY Cache_glColor4fv(const GLfloat * v)
+{
+	if (dyngl_set_colour(v[0], v[1], v[2], v[3]))
+		dyngl_cached.glColor4fv(v);
+}
+
+static void DYNGLENTRY Cache_glColor4ub(GLubyte red, GLubyte green, GLubyte blue, GLubyte alpha)
+{
+	if (dyngl_set_colour(red / 255.0f, green / 255.0f, blue / 255.0f, alpha / 255.0f))
+		dyngl_cached.glColor4ub(red, green, blue, alpha);
+}
+
+static void DYNGLENTRY Cache_glColor4ubv(const GLubyte * v)
+{
+	if (dyngl_set_colour(v[0] / 255.0f, v[1] / 255.0f, v[2] / 255.0f, v[3] / 255.0f))
+		dyngl_cached.glColor4ubv(v);
+}
+
+static void DYNGLENTRY Cache_glDeleteTextures(GLsizei n, const GLuint * textures)
+{
+	GLsizei i;
+
+	for (i = 0; i < n; i++)
+		if (textures[i] == dyngl_state.texture)
+			dyngl_state.texture_known = SDL_FALSE;
+	dyngl_cached.glDeleteTextures(n, textures);
+}
+
+static void DYNGLENTRY Cache_glDisable(GLenum cap)
+{
+	if (dyngl_set_cap(cap, GL_FALSE))
+		dyngl_cached.glDisable(cap);
+}
+
+static void DYNGLENTRY Cache_glDrawArrays(GLenum mode, GLint first, GLsizei count)
+{
+	dyngl_state.colour_known = SDL_FALSE;
+	dyngl_cached.glDrawArrays(mode, first, count);
+}
+
+static void DYNGLENTRY Cache_glDrawElements(GLenum mode, GLsizei count, GLenum type, const GLvoid * indices)
+{
+	dyngl_state.colour_known = SDL_FALSE;
+	dyngl_cached.glDrawElements(mode, count, type, indices);
+}
+
+static void DYNGLENTRY Cache_glDrawRangeElements(GLenum mode, GLuint start, GLuint end, GLsizei count, GLenum type, const GLvoid * indices)
+{
+	dyngl_state.colour_known = SDL_FALSE;
+	dyngl_cached.glDrawRangeElements(mode, start, end, count, type, indices);
+}
+
+static void DYNGLENTRY Cache_glDrawRangeElementsEXT(GLenum mode, GLuint start, GLuint end, GLsizei count, GLenum type, const GLvoid * indices)
+{
+	dyngl_state.colour_known = SDL_FALSE;
+	dyngl_cached.glDrawRangeElementsEXT(mode, start, end, count, type, indices);
+}
+
+static void DYNGLENTRY Cache_glEnable(GLenum cap)
+{
+	if (dyngl_set_cap(cap, GL_TRUE))
+		dyngl_cached.glEnable(cap);
+}
+
+static void DYNGLENTRY Cache_glMatrixMode(GLenum mode)
+{
+	if (dyngl_state.matrix_mode_known && (dyngl_state.matrix_mode == mode)) {
+		dyngl_counters.state_elided++;
+		return;
+	}
+	dyngl_state.matrix_mode_known = SDL_TRUE;
+	dyngl_state.matrix_mode = mode;
+	dyngl_cached.glMatrixMode(mode);
+}
 
 
 /*
@@ -173,6 +481,31 @@ SDL_bool DynGL_LoadLibrary(char *name)
 		return SDL_FALSE;
 	}
 
+	dyngl_getproc = SDL_GL_GetProcAddress;
+	dyngl_loaded = SDL_TRUE;
+	return SDL_TRUE;
+}
+
+
+/*
+ * DynGL_LoadProcAddress
+ *
+ * Like DynGL_LoadLibrary, but for an OpenGL library the caller has already
+ * loaded itself, for example for an offscreen context which SDL knows nothing
+ * about.  DynGL_GetFunctions () will look up the functions with getproc
+ * instead of SDL_GL_GetProcAddress ().
+ */
+SDL_bool DynGL_LoadProcAddress(void *(*getproc) (const char *name))
+{
+	if (dyngl_loaded) {
+		SDL_SetError("DynGL_LoadProcAddress: Library already loaded");
+		return SDL_FALSE;
+	}
+
+	LIST_INIT(extensions);
+	LIST_INIT(bad_extensions);
+
+	dyngl_getproc = getproc;
 	dyngl_loaded = SDL_TRUE;
 	return SDL_TRUE;
 }
@@ -194,6 +527,9 @@ void DynGL_CloseLibrary(void)
 		return;
 
 	dyngl_loaded = SDL_FALSE;
+	dyngl_getproc = NULL;
+	dyngl_counting = SDL_FALSE;
+	dyngl_caching = SDL_FALSE;
 
 	free(gl_extensions_list);
 
@@ -223,6 +559,149 @@ void DynGL_CloseLibrary(void)
 }
 
 
+/*
+ * DynGL_SetCounting
+ *
+ * Turns the counting wrappers on or off.  The alternate of
+ * glDrawRangeElements is left alone, it calls glDrawRangeElementsEXT or
+ * glDrawElements which get counted themselves.  Don't call
+ * DynGL_GetFunctions () while counting is on, it would overwrite the
+ * wrappers.
+ */
+void DynGL_SetCounting(SDL_bool enable)
+{
+	if (!dyngl_loaded || (enable == dyngl_counting))
+		return;
+
+	if (enable) {
+		dyngl_real.glBegin = qglBegin;
+		dyngl_real.glBindTexture = qglBindTexture;
+		dyngl_real.glDrawArrays = qglDrawArrays;
+		dyngl_real.glDrawElements = qglDrawElements;
+		dyngl_real.glDrawRangeElements = qglDrawRangeElements;
+		dyngl_real.glDrawRangeElementsEXT = qglDrawRangeElementsEXT;
+		dyngl_real.glVertex2f = qglVertex2f;
+		dyngl_real.glVertex3f = qglVertex3f;
+		dyngl_real.glVertex3fv = qglVertex3fv;
+
+		qglBegin = Count_glBegin;
+		qglBindTexture = Count_glBindTexture;
+		qglDrawArrays = Count_glDrawArrays;
+		qglDrawElements = Count_glDrawElements;
+		if (qglDrawRangeElements != Alt_glDrawRangeElements)
+			qglDrawRangeElements = Count_glDrawRangeElements;
+		if (qglDrawRangeElementsEXT)
+			qglDrawRangeElementsEXT = Count_glDrawRangeElementsEXT;
+		qglVertex2f = Count_glVertex2f;
+		qglVertex3f = Count_glVertex3f;
+		qglVertex3fv = Count_glVertex3fv;
+	} else {
+		qglBegin = dyngl_real.glBegin;
+		qglBindTexture = dyngl_real.glBindTexture;
+		qglDrawArrays = dyngl_real.glDrawArrays;
+		qglDrawElements = dyngl_real.glDrawElements;
+		qglDrawRangeElements = dyngl_real.glDrawRangeElements;
+		qglDrawRangeElementsEXT = dyngl_real.glDrawRangeElementsEXT;
+		qglVertex2f = dyngl_real.glVertex2f;
+		qglVertex3f = dyngl_real.glVertex3f;
+		qglVertex3fv = dyngl_real.glVertex3fv;
+	}
+
+	dyngl_counting = enable;
+}
+
+
+/*
+ * DynGL_SetStateCache
+ *
+ * Turns the state cache on or off, see above.  Like with the counting,
+ * don't call DynGL_GetFunctions () while it is on.
+ */
+void DynGL_SetStateCache(SDL_bool enable)
+{
+	if (!dyngl_loaded || (enable == dyngl_caching))
+		return;
+
+	if (enable) {
+		dyngl_cached.glActiveTextureARB = qglActiveTextureARB;
+		dyngl_cached.glBindTexture = qglBindTexture;
+		dyngl_cached.glBlendFunc = qglBlendFunc;
+		dyngl_cached.glColor3f = qglColor3f;
+		dyngl_cached.glColor3ub = qglColor3ub;
+		dyngl_cached.glColor3ubv = qglColor3ubv;
+		dyngl_cached.glColor4f = qglColor4f;
+		dyngl_cached.glColor4fv = qglColor4fv;
+		dyngl_cached.glColor4ub = qglColor4ub;
+		dyngl_cached.glColor4ubv = qglColor4ubv;
+		dyngl_cached.glDeleteTextures = qglDeleteTextures;
+		dyngl_cached.glDisable = qglDisable;
+		dyngl_cached.glDrawArrays = qglDrawArrays;
+		dyngl_cached.glDrawElements = qglDrawElements;
+		dyngl_cached.glDrawRangeElements = qglDrawRangeElements;
+		dyngl_cached.glDrawRangeElementsEXT = qglDrawRangeElementsEXT;
+		dyngl_cached.glEnable = qglEnable;
+		dyngl_cached.glMatrixMode = qglMatrixMode;
+
+		DynGL_ResetStateCache();
+
+		if (qglActiveTextureARB)
+			qglActiveTextureARB = Cache_glActiveTextureARB;
+		qglBindTexture = Cache_glBindTexture;
+		qglBlendFunc = Cache_glBlendFunc;
+		qglColor3f = Cache_glColor3f;
+		qglColor3ub = Cache_glColor3ub;
+		qglColor3ubv = Cache_glColor3ubv;
+		qglColor4f = Cache_glColor4f;
+		qglColor4fv = Cache_glColor4fv;
+		qglColor4ub = Cache_glColor4ub;
+		qglColor4ubv = Cache_glColor4ubv;
+		qglDeleteTextures = Cache_glDeleteTextures;
+		qglDisable = Cache_glDisable;
+		qglDrawArrays = Cache_glDrawArrays;
+		qglDrawElements = Cache_glDrawElements;
+		if (qglDrawRangeElements != Alt_glDrawRangeElements)
+			qglDrawRangeElements = Cache_glDrawRangeElements;
+		if (qglDrawRangeElementsEXT)
+			qglDrawRangeElementsEXT = Cache_glDrawRangeElementsEXT;
+		qglEnable = Cache_glEnable;
+		qglMatrixMode = Cache_glMatrixMode;
+	} else {
+		qglActiveTextureARB = dyngl_cached.glActiveTextureARB;
+		qglBindTexture = dyngl_cached.glBindTexture;
+		qglBlendFunc = dyngl_cached.glBlendFunc;
+		qglColor3f = dyngl_cached.glColor3f;
+		qglColor3ub = dyngl_cached.glColor3ub;
+		qglColor3ubv = dyngl_cached.glColor3ubv;
+		qglColor4f = dyngl_cached.glColor4f;
+		qglColor4fv = dyngl_cached.glColor4fv;
+		qglColor4ub = dyngl_cached.glColor4ub;
+		qglColor4ubv = dyngl_cached.glColor4ubv;
+		qglDeleteTextures = dyngl_cached.glDeleteTextures;
+		qglDisable = dyngl_cached.glDisable;
+		qglDrawArrays = dyngl_cached.glDrawArrays;
+		qglDrawElements = dyngl_cached.glDrawElements;
+		qglDrawRangeElements = dyngl_cached.glDrawRangeElements;
+		qglDrawRangeElementsEXT = dyngl_cached.glDrawRangeElementsEXT;
+		qglEnable = dyngl_cached.glEnable;
+		qglMatrixMode = dyngl_cached.glMatrixMode;
+	}
+
+	dyngl_caching = enable;
+}
+
+
+/*
+ * DynGL_ResetStateCache
+ *
+ * Marks all tracked state as unknown, the next call of every kind gets
+ * through to the driver again.
+ */
+void DynGL_ResetStateCache(void)
+{
+	memset(&dyngl_state, 0, sizeof(dyngl_state));
+}
+
+
 /*
  * DynGL_BadExtension
  *
@@ -303,14 +782,14 @@ SDL_bool DynGL_GetFunctions(void (*errfunc) (const char *fmt, ...))
 
 	/* Assign all of the functions, except extensions */
 #define DYNGL_NEED(ret, name, args)											\
-	if (!(q##name = SDL_GL_GetProcAddress (#name)))							\
+	if (!(q##name = dyngl_getproc (#name)))							\
 	{																		\
 		SDL_SetError ("DynGL_GetFunctions: can't find %s", #name);			\
 		return SDL_FALSE;													\
 	}
 #define DYNGL_EXT(ret, name, args, extension)
 #define DYNGL_WANT(ret, name, args, alt)									\
-	if (!(q##name = SDL_GL_GetProcAddress (#name)))							\
+	if (!(q##name = dyngl_getproc (#name)))							\
 		q##name = alt;
 #include "dglfuncs.h"
 #undef DYNGL_NEED
@@ -336,7 +815,7 @@ SDL_bool DynGL_GetFunctions(void (*errfunc) (const char *fmt, ...))
 #define DYNGL_NEED(ret, name, args)
 #define DYNGL_EXT(ret, name, args, extension)								\
 	if (DynGL_HasExtension (extension))										\
-		if (!(q##name = SDL_GL_GetProcAddress (#name)))						\
+		if (!(q##name = dyngl_getproc (#name)))						\
 		{																	\
 			DynGL_BadExtension (extension);									\
 				if (errfunc != NULL)										\
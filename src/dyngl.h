@@ -70,6 +70,11 @@
  *                      Returns SDL_TRUE on success.  Call this before you
  *                      attempt to SDL_InitVideoMode.
  *
+ * DynGL_LoadProcAddress - Instead of DynGL_LoadLibrary, for an OpenGL
+ *                      library loaded by the caller.  The functions get looked
+ *                      up with the given function.  Returns SDL_TRUE on
+ *                      success.
+ *
  * DynGL_CloseLibrary - Closes the OpenGL library.  All function pointers are
  *                      nullified and the extension lists are cleared.
  *
@@ -91,12 +96,46 @@
  *                      by DynGL_HasExtension and added instead to the list of
  *                      bad extensions.  Nothing is done if the driver does
  *                      not claim to have the extension.
+ *
+ * DynGL_SetCounting  - With SDL_TRUE, the drawing and texture binding
+ *                      functions are routed through wrappers which count the
+ *                      calls in dyngl_counters, SDL_FALSE restores the
+ *                      driver's functions.  Call after DynGL_GetFunctions ().
+ *
+ * DynGL_SetStateCache - With SDL_TRUE, state changes which would not change
+ *                      anything are dropped before they reach the driver,
+ *                      see dyngl.c for the state which is tracked.  Turn it
+ *                      on after DynGL_SetCounting, so only the calls that
+ *                      reach the driver are counted, and off in reverse
+ *                      order.
+ *
+ * DynGL_ResetStateCache - Forgets the tracked state, call it when OpenGL
+ *                      state was changed behind DynGL's back.
  */
 DYNGLCALL SDL_bool DynGL_LoadLibrary(char *name);
+DYNGLCALL SDL_bool DynGL_LoadProcAddress(void *(*getproc) (const char *name));
 DYNGLCALL void DynGL_CloseLibrary(void);
 DYNGLCALL SDL_bool DynGL_GetFunctions(void (*errfunc) (const char *fmt, ...));
 DYNGLCALL SDL_bool DynGL_HasExtension(char *ext);
 DYNGLCALL void DynGL_BadExtension(char *ext);
+DYNGLCALL void DynGL_SetCounting(SDL_bool enable);
+DYNGLCALL void DynGL_SetStateCache(SDL_bool enable);
+DYNGLCALL void DynGL_ResetStateCache(void);
+
+/*
+ * Counters
+ *
+ * Filled while DynGL_SetCounting or DynGL_SetStateCache is on.  Nobody
+ * resets them but you, so clear them at the start of every frame.
+ */
+typedef struct dyngl_counters_s {
+	Uint32 draw_calls;		/* glBegin and glDraw* calls */
+	Uint32 vertices;		/* glVertex* calls and vertices drawn by glDraw* */
+	Uint32 texture_binds;	/* glBindTexture calls */
+	Uint32 state_elided;	/* calls dropped by the state cache */
+} dyngl_counters_t;
+
+DYNGLCALL dyngl_counters_t dyngl_counters;
 
 /*
  * Types
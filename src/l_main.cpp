@@ -19,22 +19,38 @@
  *
  */
 
+#include <algorithm>
 #include "debug.h"
 #include "SDL.h"
 #include "l_main.h"
 
 #define RCSID "$Id: l_main.cpp,v 1.10 2002/09/20 15:59:02 crow Exp $"
 
-/// \brief reads the mesh data.
+/// \brief copies a staging vector into a mesh pool.
+template < class T > static void copy_mesh_pool(std::vector < T > &src, prtl::array < T > &dst)
+{
+	bitu32 i;
+
+	dst.resize(src.size());
+	for (i = 0; i < src.size(); i++)
+		dst[i] = src[i];
+}
+
+/** \brief reads the mesh data.
+  *
+  * mesh_indices holds byte offsets into the mesh data on disk, several entries can point to the
+  * same mesh. Every distinct offset is read once (in ascending order) and mesh_indices gets
+  * remapped to indices into meshes. The mesh contents go into the flattened mesh pools.
+  */
 void TR_Level::read_mesh_data(SDL_RWops * const src)
 {
 	bitu8 *buffer;
 	SDL_RWops *newsrc = NULL;
 	bitu32 size;
-	bitu32 pos = 0;
-	int mesh = 0;
 	bitu32 i;
 	bitu32 num_mesh_data;
+	std::vector < bitu32 > offsets;
+	tr_mesh_staging_t staging;
 
 	num_mesh_data = read_bitu32(src);
 
@@ -52,29 +68,27 @@ void TR_Level::read_mesh_data(SDL_RWops * const src)
 		for (i = 0; i < this->mesh_indices.size(); i++)
 			this->mesh_indices[i] = read_bitu32(src);
 
-		this->meshes.resize(this->mesh_indices.size());
+		offsets.resize(this->mesh_indices.size());
+		for (i = 0; i < this->mesh_indices.size(); i++)
+			offsets[i] = this->mesh_indices[i];
+		std::sort(offsets.begin(), offsets.end());
+		offsets.erase(std::unique(offsets.begin(), offsets.end()), offsets.end());
+
+		for (i = 0; i < this->mesh_indices.size(); i++)
+			this->mesh_indices[i] = std::lower_bound(offsets.begin(), offsets.end(), this->mesh_indices[i]) - offsets.begin();
 
-		for (i = 0; i < this->mesh_indices.size(); i++) {
-			bitu32 j;
+		this->meshes.resize(offsets.size());
 
-			for (j = 0; j < this->mesh_indices.size(); j++)
-				if (this->mesh_indices[j] == pos)
-					this->mesh_indices[j] = mesh;
+		for (i = 0; i < offsets.size(); i++) {
+			if (offsets[i] >= size)
+				throw TR_ReadError ("read_tr_mesh_data: mesh offset out of range", __FILE__, __LINE__, RCSID);
 
-			SDL_RWseek(newsrc, pos, SEEK_SET);
+			SDL_RWseek(newsrc, offsets[i], SEEK_SET);
 
 			if (this->game_version >= TR_IV)
-				read_tr4_mesh(newsrc, this->meshes[mesh]);
+				read_tr4_mesh(newsrc, this->meshes[i], staging);
 			else
-				read_tr_mesh(newsrc, this->meshes[mesh]);
-
-			mesh++;
-
-			for (j = 0; j < this->mesh_indices.size(); j++)
-				if (this->mesh_indices[j] > pos) {
-					pos = this->mesh_indices[j];
-					break;
-				}
+				read_tr_mesh(newsrc, this->meshes[i], staging);
 		}
 		SDL_RWclose(newsrc);
 		newsrc = NULL;
@@ -87,6 +101,12 @@ void TR_Level::read_mesh_data(SDL_RWops * const src)
 
 		throw;
 	}
+
+	copy_mesh_pool(staging.vertices, this->mesh_vertices);
+	copy_mesh_pool(staging.normals, this->mesh_normals);
+	copy_mesh_pool(staging.lights, this->mesh_lights);
+	copy_mesh_pool(staging.rectangles, this->mesh_rectangles);
+	copy_mesh_pool(staging.triangles, this->mesh_triangles);
 }
 
 /// \brief reads frame and moveable data.
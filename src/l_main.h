@@ -15,6 +15,18 @@ typedef enum {
 	TR_V
 } tr_version_e;
 
+/** \brief Growable mesh pools.
+  *
+  * Only used while reading the mesh data, the result gets copied into the TR_Level pools.
+  */
+typedef struct {
+	std::vector < tr5_vertex_t > vertices;
+	std::vector < tr5_vertex_t > normals;
+	std::vector < bit16 > lights;
+	std::vector < tr4_face4_t > rectangles;
+	std::vector < tr4_face3_t > triangles;
+} tr_mesh_staging_t;
+
 class TR_ReadError {
       public:
 	char *m_message;///< \brief takes the pointer to the error string.
@@ -47,6 +59,11 @@ class TR_Level {
 	tr5_room_array_t rooms;	///< \brief all rooms (normal and alternate).
 	bitu16_array_t floor_data;	///< \brief the floor data.
 	tr4_mesh_array_t meshes;	///< \brief all meshes (static and moveables).
+	tr5_vertex_array_t mesh_vertices;	///< \brief vertices of all meshes.
+	tr5_vertex_array_t mesh_normals;	///< \brief normals of all meshes.
+	bit16_array_t mesh_lights;	///< \brief vertex lighting of all meshes.
+	tr4_face4_array_t mesh_rectangles;	///< \brief rectangles of all meshes.
+	tr4_face3_array_t mesh_triangles;	///< \brief triangles of all meshes.
 	bitu32_array_t mesh_indices;	///< \brief mesh index table.
 	tr_animation_array_t animations;	///< \brief animations for moveables.
 	tr_state_change_array_t state_changes;	///< \brief state changes for moveables.
@@ -119,7 +136,7 @@ class TR_Level {
 	void read_tr_object_texture(SDL_RWops * const src, tr4_object_texture_t & object_texture);
 	void read_tr_sprite_texture(SDL_RWops * const src, tr_sprite_texture_t & sprite_texture);
 	void read_tr_sprite_sequence(SDL_RWops * const src, tr_sprite_sequence_t & sprite_sequence);
-	void read_tr_mesh(SDL_RWops * const src, tr4_mesh_t & mesh);
+	void read_tr_mesh(SDL_RWops * const src, tr4_mesh_t & mesh, tr_mesh_staging_t & staging);
 	void read_tr_animation(SDL_RWops * const src, tr_animation_t & animation);
 	void read_tr_meshtree(SDL_RWops * const src, tr_meshtree_t & meshtree);
 	void read_tr_frame(SDL_RWops * const src, tr_frame_t & frame, bitu32 num_rotations);
@@ -154,8 +171,9 @@ class TR_Level {
 	void read_tr4_room(SDL_RWops * const src, tr5_room_t & room);
 	void read_tr4_object_texture_vert(SDL_RWops * const src, tr4_object_texture_vert_t & vert);
 	void read_tr4_object_texture(SDL_RWops * const src, tr4_object_texture_t & object_texture);
-	void read_tr4_mesh(SDL_RWops * const src, tr4_mesh_t & mesh);
+	void read_tr4_mesh(SDL_RWops * const src, tr4_mesh_t & mesh, tr_mesh_staging_t & staging);
 	void read_tr4_animation(SDL_RWops * const src, tr_animation_t & animation);
+	void read_tr4_flyby_camera(SDL_RWops * const src, tr4_flyby_camera_t & camera);
 	void read_tr4_level(SDL_RWops * const _src);
 
 	void read_tr5_room_light(SDL_RWops * const src, tr5_room_light_t & light);
@@ -380,7 +380,7 @@ void TR_Level::read_tr_sprite_sequence(SDL_RWops * const src, tr_sprite_sequence
   * The read num_normals value is positive when normals are available and negative when light
   * values are available. The values get set appropiatly.
   */
-void TR_Level::read_tr_mesh(SDL_RWops * const src, tr4_mesh_t & mesh)
+void TR_Level::read_tr_mesh(SDL_RWops * const src, tr4_mesh_t & mesh, tr_mesh_staging_t & staging)
 {
 	int i;
 
@@ -388,43 +388,50 @@ void TR_Level::read_tr_mesh(SDL_RWops * const src, tr4_mesh_t & mesh)
 	mesh.collision_size = read_bit32(src);
 
 	mesh.num_vertices = read_bit16(src);
-	mesh.vertices.resize(mesh.num_vertices);
+	mesh.vertex_offset = staging.vertices.size();
+	staging.vertices.resize(mesh.vertex_offset + mesh.num_vertices);
 	for (i = 0; i < mesh.num_vertices; i++)
-		read_tr_vertex16(src, mesh.vertices[i]);
+		read_tr_vertex16(src, staging.vertices[mesh.vertex_offset + i]);
 
 	mesh.num_normals = read_bit16(src);
+	mesh.normal_offset = staging.normals.size();
+	mesh.light_offset = staging.lights.size();
 	if (mesh.num_normals >= 0) {
 		mesh.num_lights = 0;
-		mesh.normals.resize(mesh.num_normals);
+		staging.normals.resize(mesh.normal_offset + mesh.num_normals);
 		for (i = 0; i < mesh.num_normals; i++)
-			read_tr_vertex16(src, mesh.normals[i]);
+			read_tr_vertex16(src, staging.normals[mesh.normal_offset + i]);
 	} else {
 		mesh.num_lights = -mesh.num_normals;
 		mesh.num_normals = 0;
-		mesh.lights.resize(mesh.num_lights);
+		staging.lights.resize(mesh.light_offset + mesh.num_lights);
 		for (i = 0; i < mesh.num_lights; i++)
-			mesh.lights[i] = read_bit16(src);
+			staging.lights[mesh.light_offset + i] = read_bit16(src);
 	}
 
 	mesh.num_textured_rectangles = read_bit16(src);
-	mesh.textured_rectangles.resize(mesh.num_textured_rectangles);
+	mesh.textured_rectangle_offset = staging.rectangles.size();
+	staging.rectangles.resize(mesh.textured_rectangle_offset + mesh.num_textured_rectangles);
 	for (i = 0; i < mesh.num_textured_rectangles; i++)
-		read_tr_face4(src, mesh.textured_rectangles[i]);
+		read_tr_face4(src, staging.rectangles[mesh.textured_rectangle_offset + i]);
 
 	mesh.num_textured_triangles = read_bit16(src);
-	mesh.textured_triangles.resize(mesh.num_textured_triangles);
+	mesh.textured_triangle_offset = staging.triangles.size();
+	staging.triangles.resize(mesh.textured_triangle_offset + mesh.num_textured_triangles);
 	for (i = 0; i < mesh.num_textured_triangles; i++)
-		read_tr_face3(src, mesh.textured_triangles[i]);
+		read_tr_face3(src, staging.triangles[mesh.textured_triangle_offset + i]);
 
 	mesh.num_coloured_rectangles = read_bit16(src);
-	mesh.coloured_rectangles.resize(mesh.num_coloured_rectangles);
+	mesh.coloured_rectangle_offset = staging.rectangles.size();
+	staging.rectangles.resize(mesh.coloured_rectangle_offset + mesh.num_coloured_rectangles);
 	for (i = 0; i < mesh.num_coloured_rectangles; i++)
-		read_tr_face4(src, mesh.coloured_rectangles[i]);
+		read_tr_face4(src, staging.rectangles[mesh.coloured_rectangle_offset + i]);
 
 	mesh.num_coloured_triangles = read_bit16(src);
-	mesh.coloured_triangles.resize(mesh.num_coloured_triangles);
+	mesh.coloured_triangle_offset = staging.triangles.size();
+	staging.triangles.resize(mesh.coloured_triangle_offset + mesh.num_coloured_triangles);
 	for (i = 0; i < mesh.num_coloured_triangles; i++)
-		read_tr_face3(src, mesh.coloured_triangles[i]);
+		read_tr_face3(src, staging.triangles[mesh.coloured_triangle_offset + i]);
 }
 
 /// \brief reads an animation definition.
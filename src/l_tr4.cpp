@@ -209,7 +209,7 @@ void TR_Level::read_tr4_object_texture(SDL_RWops * const src, tr4_object_texture
 	object_texture.y_size = read_bitu32(src);
 }
 
-void TR_Level::read_tr4_mesh(SDL_RWops * const src, tr4_mesh_t & mesh)
+void TR_Level::read_tr4_mesh(SDL_RWops * const src, tr4_mesh_t & mesh, tr_mesh_staging_t & staging)
 {
 	int i;
 
@@ -217,36 +217,43 @@ void TR_Level::read_tr4_mesh(SDL_RWops * const src, tr4_mesh_t & mesh)
 	mesh.collision_size = read_bit32(src);
 
 	mesh.num_vertices = read_bit16(src);
-	mesh.vertices.resize(mesh.num_vertices);
+	mesh.vertex_offset = staging.vertices.size();
+	staging.vertices.resize(mesh.vertex_offset + mesh.num_vertices);
 	for (i = 0; i < mesh.num_vertices; i++)
-		read_tr_vertex16(src, mesh.vertices[i]);
+		read_tr_vertex16(src, staging.vertices[mesh.vertex_offset + i]);
 
 	mesh.num_normals = read_bit16(src);
+	mesh.normal_offset = staging.normals.size();
+	mesh.light_offset = staging.lights.size();
 	if (mesh.num_normals >= 0) {
 		mesh.num_lights = 0;
-		mesh.normals.resize(mesh.num_normals);
+		staging.normals.resize(mesh.normal_offset + mesh.num_normals);
 		for (i = 0; i < mesh.num_normals; i++)
-			read_tr_vertex16(src, mesh.normals[i]);
+			read_tr_vertex16(src, staging.normals[mesh.normal_offset + i]);
 	} else {
 		mesh.num_lights = -mesh.num_normals;
 		mesh.num_normals = 0;
-		mesh.lights.resize(mesh.num_lights);
+		staging.lights.resize(mesh.light_offset + mesh.num_lights);
 		for (i = 0; i < mesh.num_lights; i++)
-			mesh.lights[i] = read_bit16(src);
+			staging.lights[mesh.light_offset + i] = read_bit16(src);
 	}
 
 	mesh.num_textured_rectangles = read_bit16(src);
-	mesh.textured_rectangles.resize(mesh.num_textured_rectangles);
+	mesh.textured_rectangle_offset = staging.rectangles.size();
+	staging.rectangles.resize(mesh.textured_rectangle_offset + mesh.num_textured_rectangles);
 	for (i = 0; i < mesh.num_textured_rectangles; i++)
-		read_tr4_face4(src, mesh.textured_rectangles[i]);
+		read_tr4_face4(src, staging.rectangles[mesh.textured_rectangle_offset + i]);
 
 	mesh.num_textured_triangles = read_bit16(src);
-	mesh.textured_triangles.resize(mesh.num_textured_triangles);
+	mesh.textured_triangle_offset = staging.triangles.size();
+	staging.triangles.resize(mesh.textured_triangle_offset + mesh.num_textured_triangles);
 	for (i = 0; i < mesh.num_textured_triangles; i++)
-		read_tr4_face3(src, mesh.textured_triangles[i]);
+		read_tr4_face3(src, staging.triangles[mesh.textured_triangle_offset + i]);
 
 	mesh.num_coloured_rectangles = 0;
+	mesh.coloured_rectangle_offset = staging.rectangles.size();
 	mesh.num_coloured_triangles = 0;
+	mesh.coloured_triangle_offset = staging.triangles.size();
 }
 
 /// \brief reads an animation definition.
@@ -278,6 +285,21 @@ void TR_Level::read_tr4_animation(SDL_RWops * const src, tr_animation_t & animat
 	animation.anim_command = read_bitu16(src);
 }
 
+/// \brief reads a flyby camera.
+void TR_Level::read_tr4_flyby_camera(SDL_RWops * const src, tr4_flyby_camera_t & camera)
+{
+	read_tr_vertex32(src, camera.pos);
+	read_tr_vertex32(src, camera.target);
+	camera.sequence = read_bitu8(src);
+	camera.index = read_bitu8(src);
+	camera.fov = read_bitu16(src);
+	camera.roll = read_bit16(src);
+	camera.timer = read_bitu16(src);
+	camera.speed = read_bitu16(src);
+	camera.flags = read_bitu16(src);
+	camera.room = read_bitu32(src);
+}
+
 void TR_Level::read_tr4_level(SDL_RWops * const _src)
 {
 	SDL_RWops *src = _src;
@@ -512,7 +534,8 @@ void TR_Level::read_tr4_level(SDL_RWops * const _src)
 		SDL_RWseek(src, this->cameras.size() * 16, SEEK_CUR);
 
 		this->flyby_cameras.resize(read_bitu32(src));
-		SDL_RWseek(src, this->flyby_cameras.size() * 40, SEEK_CUR);
+		for (i = 0; i < this->flyby_cameras.size(); i++)
+			read_tr4_flyby_camera(src, this->flyby_cameras[i]);
 
 		this->sound_sources.resize(read_bitu32(src));
 		SDL_RWseek(src, this->sound_sources.size() * 16, SEEK_CUR);
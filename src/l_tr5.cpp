@@ -663,7 +663,8 @@ void TR_Level::read_tr5_level(SDL_RWops * const src)
 	SDL_RWseek(src, this->cameras.size() * 16, SEEK_CUR);
 
 	this->flyby_cameras.resize(read_bitu32(src));
-	SDL_RWseek(src, this->flyby_cameras.size() * 40, SEEK_CUR);
+	for (i = 0; i < this->flyby_cameras.size(); i++)
+		read_tr4_flyby_camera(src, this->flyby_cameras[i]);
 
 	this->sound_sources.resize(read_bitu32(src));
 	SDL_RWseek(src, this->sound_sources.size() * 16, SEEK_CUR);
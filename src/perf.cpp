@@ -0,0 +1,202 @@
+/*
+ * Copyright 2002 - Florian Schulze <crow@icculus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * This file is part of vt.
+ *
+ */
+
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <algorithm>
+#include "SDL.h"
+#include "dyngl.h"
+#include "vt_level.h"
+#include "glmath.h"
+#include "bench.h"
+#include "perf.h"
+
+#define RCSID "$Id$"
+
+static perf_frame_t history[PERF_HISTORY];	///< \brief ring buffer of the last frames.
+static bitu32 num_frames = 0;	///< \brief frames finished so far, history holds the last PERF_HISTORY of them.
+static perf_frame_t current;	///< \brief frame being measured.
+static double frame_start;	///< \brief bench_time() at perf_begin_frame().
+static double stage_start;	///< \brief bench_time() when the innermost stage was entered or resumed.
+static perf_stage_e stack[PERF_MAX_DEPTH];	///< \brief stages entered, innermost last.
+static int depth = 0;		///< \brief used entries of stack.
+static FILE *csv = NULL;	///< \brief per-frame log, NULL if not logging.
+
+/// \brief adds the time since stage_start to the innermost stage.
+static void charge_stage(double now)
+{
+	if (depth > 0)
+		current.stage_ms[stack[depth - 1]] += now - stage_start;
+	stage_start = now;
+}
+
+/** \brief starts measuring a frame.
+  *
+  * Clears dyngl_counters, they only count while DynGL_SetCounting is on.
+  */
+void perf_begin_frame()
+{
+	memset(&current, 0, sizeof(current));
+	memset(&dyngl_counters, 0, sizeof(dyngl_counters));
+	depth = 0;
+	frame_start = bench_time();
+	stage_start = frame_start;
+}
+
+/// \brief finishes the frame, adds it to the history and the CSV log.
+void perf_end_frame()
+{
+	double now = bench_time();
+	int i;
+
+	while (depth > 0)
+		perf_end();
+	current.frame_ms = now - frame_start;
+	current.draw_calls = dyngl_counters.draw_calls;
+	current.vertices = dyngl_counters.vertices;
+	current.texture_binds = dyngl_counters.texture_binds;
+	current.state_elided = dyngl_counters.state_elided;
+	history[num_frames % PERF_HISTORY] = current;
+
+	if (csv) {
+		fprintf(csv, "%u,%.3f", num_frames, current.frame_ms);
+		for (i = 0; i < PERF_NUM_STAGES; i++)
+			fprintf(csv, ",%.3f", current.stage_ms[i]);
+		fprintf(csv, ",%u,%u,%u,%u\n", current.draw_calls, current.vertices, current.texture_binds, current.state_elided);
+	}
+	num_frames++;
+}
+
+/** \brief enters a stage of the frame.
+  *
+  * Stages nest, the time of an inner stage does not count for the outer one. Leave it with
+  * perf_end(). Deeper than PERF_MAX_DEPTH stages are charged to the innermost one.
+  */
+void perf_begin(perf_stage_e stage)
+{
+	charge_stage(bench_time());
+	if (depth < PERF_MAX_DEPTH)
+		stack[depth++] = stage;
+}
+
+/// \brief leaves the stage entered last.
+void perf_end()
+{
+	charge_stage(bench_time());
+	if (depth > 0)
+		depth--;
+}
+
+/// \brief returns the p99 (nearest rank) of count values, sorts values.
+static double p99(double *values, bitu32 count)
+{
+	bitu32 rank = (count * 99 + 99) / 100;
+
+	std::sort(values, values + count);
+	return values[(rank > 0) ? rank - 1 : 0];
+}
+
+/** \brief averages and p99 values of the last PERF_HISTORY frames.
+  *
+  * Both are zero before the first frame has finished.
+  */
+void perf_get_stats(perf_frame_t & avg, perf_frame_t & worst)
+{
+	bitu32 count = (num_frames < PERF_HISTORY) ? num_frames : PERF_HISTORY;
+	double values[PERF_HISTORY];
+	double sums[PERF_NUM_STAGES + 5];
+	bitu32 i;
+	int j;
+
+	memset(&avg, 0, sizeof(avg));
+	memset(&worst, 0, sizeof(worst));
+	if (count == 0)
+		return;
+
+	// one pass per value, the p99 needs them sorted
+	for (j = 0; j < PERF_NUM_STAGES + 5; j++) {
+		sums[j] = 0.0;
+		for (i = 0; i < count; i++) {
+			perf_frame_t &f = history[i];
+
+			if (j < PERF_NUM_STAGES)
+				values[i] = f.stage_ms[j];
+			else if (j == PERF_NUM_STAGES)
+				values[i] = f.frame_ms;
+			else if (j == PERF_NUM_STAGES + 1)
+				values[i] = f.draw_calls;
+			else if (j == PERF_NUM_STAGES + 2)
+				values[i] = f.vertices;
+			else if (j == PERF_NUM_STAGES + 3)
+				values[i] = f.texture_binds;
+			else
+				values[i] = f.state_elided;
+			sums[j] += values[i];
+		}
+		sums[j] /= count;
+		values[0] = p99(values, count);
+
+		if (j < PERF_NUM_STAGES) {
+			avg.stage_ms[j] = sums[j];
+			worst.stage_ms[j] = values[0];
+		} else if (j == PERF_NUM_STAGES) {
+			avg.frame_ms = sums[j];
+			worst.frame_ms = values[0];
+		} else if (j == PERF_NUM_STAGES + 1) {
+			avg.draw_calls = (bitu32)(sums[j] + 0.5);
+			worst.draw_calls = (bitu32)values[0];
+		} else if (j == PERF_NUM_STAGES + 2) {
+			avg.vertices = (bitu32)(sums[j] + 0.5);
+			worst.vertices = (bitu32)values[0];
+		} else if (j == PERF_NUM_STAGES + 3) {
+			avg.texture_binds = (bitu32)(sums[j] + 0.5);
+			worst.texture_binds = (bitu32)values[0];
+		} else {
+			avg.state_elided = (bitu32)(sums[j] + 0.5);
+			worst.state_elided = (bitu32)values[0];
+		}
+	}
+}
+
+/** \brief logs every following frame to a CSV file.
+  *
+  * Columns: frame, frame_ms, one column per stage in perf_stage_e order, draw_calls, vertices,
+  * texture_binds, state_elided. Returns false if the file can't be created.
+  */
+bool perf_open_csv(const char *filename)
+{
+	perf_close_csv();
+	if ((csv = fopen(filename, "w")) == NULL)
+		return false;
+	fprintf(csv, "frame,frame_ms,portals_ms,rooms_ms,items_ms,hud_ms,draw_calls,vertices,texture_binds,state_elided\n");
+	return true;
+}
+
+/// \brief closes the file of perf_open_csv.
+void perf_close_csv()
+{
+	if (csv) {
+		fclose(csv);
+		csv = NULL;
+	}
+}
@@ -0,0 +1,38 @@
+#ifndef _PERF_H_
+#define _PERF_H_
+
+/// \brief Parts of a frame which get timed separately.
+typedef enum {
+	PERF_PORTALS,		///< \brief portal traversal and frustum narrowing.
+	PERF_ROOMS,		///< \brief room geometry and room static meshes.
+	PERF_ITEMS,		///< \brief items of the visible rooms.
+	PERF_HUD,		///< \brief overlay.
+	PERF_NUM_STAGES
+} perf_stage_e;
+
+#define PERF_HISTORY 128	///< \brief frames the averages and p99 values are taken over.
+#define PERF_MAX_DEPTH 8	///< \brief nesting limit of perf_begin().
+
+/** \brief Measurements of one frame.
+  *
+  * The stage times are exclusive, time outside of all stages only counts for frame_ms. The
+  * counters come from dyngl_counters and stay zero unless DynGL_SetCounting is on.
+  */
+typedef struct {
+	double frame_ms;	///< \brief perf_begin_frame() to perf_end_frame().
+	double stage_ms[PERF_NUM_STAGES];	///< \brief time spent in each stage.
+	bitu32 draw_calls;	///< \brief glBegin and glDraw* calls.
+	bitu32 vertices;	///< \brief vertices submitted.
+	bitu32 texture_binds;	///< \brief glBindTexture calls.
+	bitu32 state_elided;	///< \brief state changes dropped by the DynGL state cache.
+} perf_frame_t;
+
+void perf_begin_frame();
+void perf_end_frame();
+void perf_begin(perf_stage_e stage);
+void perf_end();
+void perf_get_stats(perf_frame_t & avg, perf_frame_t & worst);
+bool perf_open_csv(const char *filename);
+void perf_close_csv();
+
+#endif // _PERF_H_
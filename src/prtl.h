@@ -78,7 +78,7 @@ namespace prtl {
 			else
 				m_data = NULL;
 
-			if (m_data == NULL) {
+			if ((count != 0) && (m_data == NULL)) {
 				delete [] temp;
 				throw prtl_exception("array[] not enough memory", __FILE__, __LINE__);
 			}
@@ -115,6 +115,18 @@ namespace prtl {
 			for (unsigned int i = 0; i < size(); i++)
 				m_data[i] = a[i];
 		}
+
+		/// \brief exchanges the contents with a, no elements get copied.
+		void swap(array<T> &a)
+		{
+			T *data = m_data;
+			unsigned int count = m_size;
+
+			m_data = a.m_data;
+			m_size = a.m_size;
+			a.m_data = data;
+			a.m_size = count;
+		}
 	};
 
 }
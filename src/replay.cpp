@@ -0,0 +1,219 @@
+/*
+ * Copyright 2002 - Florian Schulze <crow@icculus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * This file is part of vt.
+ *
+ */
+
+
+#include <string.h>
+#include "SDL.h"
+#include "tr_types.h"
+#include "glmath.h"
+#include "replay.h"
+
+#define RCSID "$Id$"
+
+/** \brief first bytes of an input log.
+  *
+  * The format, all values little endian:
+  * header: "VTIR", bitu32 version (1), camera pos x, y, z and angles pitch, yaw, roll as floats.
+  * frame: bitu32 time, bitu8 buttons, bitu8 shift, bitu16 num_events, then num_events events.
+  * event: bitu8 type, bitu16 key, bit16 xrel, bit16 yrel.
+  */
+#define REPLAY_MAGIC "VTIR"
+#define REPLAY_VERSION 1
+#define REPLAY_FRAME_SIZE 8
+#define REPLAY_EVENT_SIZE 7
+
+static void put16(bitu8 *p, bitu16 v)
+{
+	p[0] = (bitu8)v;
+	p[1] = (bitu8)(v >> 8);
+}
+
+static void put32(bitu8 *p, bitu32 v)
+{
+	put16(p, (bitu16)v);
+	put16(p + 2, (bitu16)(v >> 16));
+}
+
+static bitu16 get16(const bitu8 *p)
+{
+	return (bitu16)(p[0] | (p[1] << 8));
+}
+
+static bitu32 get32(const bitu8 *p)
+{
+	return get16(p) | ((bitu32)get16(p + 2) << 16);
+}
+
+/** \brief reads the input of the current frame from SDL.
+  *
+  * Only the events the viewer reacts to are kept.
+  */
+void replay_poll_input(replay_frame_t & frame)
+{
+	SDL_Event event;
+
+	frame.time = SDL_GetTicks();
+	frame.num_events = 0;
+	while ((frame.num_events < REPLAY_MAX_EVENTS) && SDL_PollEvent(&event)) {
+		replay_event_t &e = frame.events[frame.num_events];
+
+		e.type = event.type;
+		e.key = 0;
+		e.xrel = 0;
+		e.yrel = 0;
+		switch (event.type) {
+		case SDL_QUIT:
+		case SDL_MOUSEBUTTONDOWN:
+		case SDL_MOUSEBUTTONUP:
+			break;
+		case SDL_MOUSEMOTION:
+			e.xrel = event.motion.xrel;
+			e.yrel = event.motion.yrel;
+			break;
+		case SDL_KEYDOWN:
+			e.key = event.key.keysym.sym;
+			break;
+		default:
+			continue;
+		}
+		frame.num_events++;
+	}
+	frame.buttons = SDL_GetMouseState(NULL, NULL);
+	frame.shift = (SDL_GetModState() & KMOD_SHIFT) ? 1 : 0;
+}
+
+/// \brief stores the camera of the header.
+static void put_camera(bitu8 *p, vec3_t & pos, ang3_t & angles)
+{
+	float values[6] = { pos.x, pos.y, pos.z, angles.pitch, angles.yaw, angles.roll };
+	int i;
+
+	for (i = 0; i < 6; i++) {
+		bitu32 v;
+
+		memcpy(&v, &values[i], 4);
+		put32(p + i * 4, v);
+	}
+}
+
+/// \brief reads the camera of the header.
+static void get_camera(const bitu8 *p, vec3_t & pos, ang3_t & angles)
+{
+	float values[6];
+	int i;
+
+	for (i = 0; i < 6; i++) {
+		bitu32 v = get32(p + i * 4);
+
+		memcpy(&values[i], &v, 4);
+	}
+	pos = vec3_t(values[0], values[1], values[2]);
+	angles = ang3_t(values[3], values[4], values[5]);
+}
+
+/** \brief creates an input log which starts with the camera at pos and angles.
+  *
+  * Returns NULL if the file can't be created. Close it with SDL_RWclose.
+  */
+SDL_RWops *replay_create(const char *filename, vec3_t & pos, ang3_t & angles)
+{
+	bitu8 header[32];
+	SDL_RWops *rw;
+
+	if ((rw = SDL_RWFromFile(filename, "wb")) == NULL)
+		return NULL;
+	memcpy(header, REPLAY_MAGIC, 4);
+	put32(header + 4, REPLAY_VERSION);
+	put_camera(header + 8, pos, angles);
+	if (SDL_RWwrite(rw, header, sizeof(header), 1) < 1) {
+		SDL_RWclose(rw);
+		return NULL;
+	}
+
+	return rw;
+}
+
+/** \brief opens an input log and returns the camera it starts with.
+  *
+  * Returns NULL if the file can't be read or is no input log.
+  */
+SDL_RWops *replay_open(const char *filename, vec3_t & pos, ang3_t & angles)
+{
+	bitu8 header[32];
+	SDL_RWops *rw;
+
+	if ((rw = SDL_RWFromFile(filename, "rb")) == NULL)
+		return NULL;
+	if ((SDL_RWread(rw, header, sizeof(header), 1) < 1) || (memcmp(header, REPLAY_MAGIC, 4) != 0) || (get32(header + 4) != REPLAY_VERSION)) {
+		SDL_RWclose(rw);
+		return NULL;
+	}
+	get_camera(header + 8, pos, angles);
+
+	return rw;
+}
+
+/// \brief appends a frame to an input log.
+void replay_write_frame(SDL_RWops * rw, replay_frame_t & frame)
+{
+	bitu8 data[REPLAY_FRAME_SIZE + REPLAY_MAX_EVENTS * REPLAY_EVENT_SIZE];
+	bitu8 *p = data + REPLAY_FRAME_SIZE;
+	bitu32 i;
+
+	put32(data, frame.time);
+	data[4] = frame.buttons;
+	data[5] = frame.shift;
+	put16(data + 6, frame.num_events);
+	for (i = 0; i < frame.num_events; i++, p += REPLAY_EVENT_SIZE) {
+		p[0] = frame.events[i].type;
+		put16(p + 1, frame.events[i].key);
+		put16(p + 3, (bitu16)frame.events[i].xrel);
+		put16(p + 5, (bitu16)frame.events[i].yrel);
+	}
+	SDL_RWwrite(rw, data, p - data, 1);
+}
+
+/// \brief reads the next frame of an input log, returns false at the end.
+bool replay_read_frame(SDL_RWops * rw, replay_frame_t & frame)
+{
+	bitu8 data[REPLAY_FRAME_SIZE + REPLAY_MAX_EVENTS * REPLAY_EVENT_SIZE];
+	bitu8 *p = data + REPLAY_FRAME_SIZE;
+	bitu32 i;
+
+	if (SDL_RWread(rw, data, REPLAY_FRAME_SIZE, 1) < 1)
+		return false;
+	frame.time = get32(data);
+	frame.buttons = data[4];
+	frame.shift = data[5];
+	frame.num_events = get16(data + 6);
+	if (frame.num_events > REPLAY_MAX_EVENTS)
+		return false;
+	if ((frame.num_events > 0) && (SDL_RWread(rw, p, frame.num_events * REPLAY_EVENT_SIZE, 1) < 1))
+		return false;
+	for (i = 0; i < frame.num_events; i++, p += REPLAY_EVENT_SIZE) {
+		frame.events[i].type = p[0];
+		frame.events[i].key = get16(p + 1);
+		frame.events[i].xrel = (bit16)get16(p + 3);
+		frame.events[i].yrel = (bit16)get16(p + 5);
+	}
+
+	return true;
+}
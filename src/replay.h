@@ -0,0 +1,29 @@
+#ifndef _REPLAY_H_
+#define _REPLAY_H_
+
+#define REPLAY_MAX_EVENTS 64	///< \brief events stored per frame, the rest waits for the next frame.
+
+/// \brief Input event, the parts of SDL_Event the viewer uses.
+typedef struct {
+	bitu8 type;		///< \brief SDL event type.
+	bitu16 key;		///< \brief SDLKey of SDL_KEYDOWN events.
+	bit16 xrel;		///< \brief relative x motion of SDL_MOUSEMOTION events.
+	bit16 yrel;		///< \brief relative y motion of SDL_MOUSEMOTION events.
+} replay_event_t;
+
+/// \brief Input of one frame of the viewer.
+typedef struct {
+	bitu32 time;		///< \brief SDL_GetTicks() at the start of the frame.
+	bitu8 buttons;		///< \brief mouse buttons held, see SDL_GetMouseState().
+	bitu8 shift;		///< \brief 1 if a shift key was held.
+	bitu16 num_events;	///< \brief used entries of events.
+	replay_event_t events[REPLAY_MAX_EVENTS];	///< \brief events of this frame in order.
+} replay_frame_t;
+
+void replay_poll_input(replay_frame_t & frame);
+SDL_RWops *replay_create(const char *filename, vec3_t & pos, ang3_t & angles);
+SDL_RWops *replay_open(const char *filename, vec3_t & pos, ang3_t & angles);
+void replay_write_frame(SDL_RWops * rw, replay_frame_t & frame);
+bool replay_read_frame(SDL_RWops * rw, replay_frame_t & frame);
+
+#endif // _REPLAY_H_
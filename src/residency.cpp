@@ -0,0 +1,684 @@
+/*
+ * Copyright 2002 - Florian Schulze <crow@icculus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * This file is part of vt.
+ *
+ */
+
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "SDL.h"
+#include "dyngl.h"
+#include "vt_level.h"
+#include "vt_dxt.h"
+#include "glmath.h"
+#include "bench.h"
+#include "residency.h"
+
+#define RCSID "$Id$"
+
+/** \brief first bytes of a compressed texture in residency_t::cache_dir.
+  *
+  * The format, all values little endian: "VTTC", bitu32 version (1), format, size of level 0,
+  * levels and bytes of all levels, then the levels largest first. The file name is the
+  * checksum of the source texels, the scale and the mipmap flag.
+  */
+#define RESIDENCY_CACHE_MAGIC "VTTC"
+#define RESIDENCY_CACHE_VERSION 1
+#define RESIDENCY_CACHE_HEADER 24
+
+static int residency_worker(void *data);
+
+/// \brief adds the tiles of mesh to tiles, each tile once.
+static void add_mesh_tiles(vt_batched_mesh_t & mesh, bitu32_array_t & tiles, bitu32 & num_tiles, bitu32 first)
+{
+	bitu32 i, j;
+
+	for (i = 0; i < mesh.batches.size(); i++) {
+		bitu16 tile = mesh.batches[i].tile;
+
+		if (tile == VT_BATCH_COLOURED)
+			continue;
+		for (j = first; j < num_tiles; j++)
+			if (tiles[j] == tile)
+				break;
+		if (j < num_tiles)
+			continue;
+		if (num_tiles >= tiles.size())
+			tiles.resize(tiles.size() * 2 + 16);
+		tiles[num_tiles++] = tile;
+	}
+}
+
+/// \brief returns the texels of a square texture of size with all mipmap levels if mipmaps is set.
+static bitu32 chain_texels(bitu32 size, bool mipmaps)
+{
+	bitu32 texels = size * size;
+
+	while (mipmaps && (size > 1)) {
+		size /= 2;
+		texels += size * size;
+	}
+
+	return texels;
+}
+
+/// \brief returns the bytes of a square texture of size in format with all mipmap levels if mipmaps is set.
+static bitu32 chain_bytes(vt_dxt_format_e format, bitu32 size, bool mipmaps)
+{
+	bitu32 bytes = vt_dxt_size(format, size);
+
+	while (mipmaps && (size > 1)) {
+		size /= 2;
+		bytes += vt_dxt_size(format, size);
+	}
+
+	return bytes;
+}
+
+/// \brief returns the RGBA8 texels of a tile as stored in the level, size gets their width and height.
+static const bitu32 *tile_pixels(VT_Level & level, bitu32 tile, bitu32 & size)
+{
+	if (level.atlas.pages.empty()) {
+		size = 256;
+		return &level.textile32[tile].pixels[0][0];
+	}
+	size = level.atlas.page_size;
+	return &level.atlas.pages[tile][0];
+}
+
+/** \brief sets up the residency manager for a level and starts the workers, nothing gets uploaded yet.
+  *
+  * The level needs its batches built and must not change while r is in use. budget is in
+  * bytes, 0 means no limit. scale is 1 or 2, the caller checks that the scaled textures are
+  * not too large for OpenGL. compress needs GL_EXT_texture_compression_s3tc and
+  * qglCompressedTexImage2DARB, the caller checks them. cache_dir has to exist, it is not
+  * copied. num_threads is clamped to 1 - RESIDENCY_MAX_THREADS.
+  */
+void residency_init(residency_t & r, VT_Level & level, GLuint first_texture, bitu32 budget, bitu32 scale, bool mipmaps, bool compress, const char *cache_dir, double upload_ms, bit32 num_threads)
+{
+	residency_texture_t empty = { VT_DXT_NONE, 0, 0, false, false, false };
+	bitu32 num_textures, size, num_tiles = 0;
+	bitu32 i, j;
+
+	num_textures = level.atlas.pages.empty() ? level.textile32.size() : level.atlas.pages.size();
+	r.textures.resize(0);
+	r.textures.resize(num_textures, empty);
+	for (i = 0; i < num_textures; i++) {
+		residency_texture_t & texture = r.textures[i];
+		const bitu32 *pixels = tile_pixels(level, i, size);
+
+		if (compress)
+			texture.format = vt_dxt_has_alpha(pixels, size * size) ? VT_DXT_BC3 : VT_DXT_BC1;
+		texture.bytes = chain_bytes(texture.format, size * scale, mipmaps);
+	}
+
+	// a room needs the tiles of its own faces and of its static meshes
+	r.room_tile_start.resize(level.rooms.size() + 1);
+	r.room_tiles.resize(0);
+	for (i = 0; i < level.rooms.size(); i++) {
+		tr5_room_t & room = level.rooms[i];
+
+		r.room_tile_start[i] = num_tiles;
+		add_mesh_tiles(level.room_batches[i], r.room_tiles, num_tiles, r.room_tile_start[i]);
+		for (j = 0; j < room.num_static_meshes; j++) {
+			tr_staticmesh_t *staticmesh = level.find_staticmesh_id(room.static_meshes[j].object_id);
+
+			if (staticmesh != NULL)
+				add_mesh_tiles(level.mesh_batches[level.mesh_indices[staticmesh->mesh]], r.room_tiles, num_tiles, r.room_tile_start[i]);
+		}
+	}
+	r.room_tile_start[level.rooms.size()] = num_tiles;
+
+	r.queue.resize(num_textures);
+	r.num_queued = 0;
+	r.level = &level;
+	r.first_texture = first_texture;
+	r.budget = budget;
+	r.scale = scale;
+	r.mipmaps = mipmaps;
+	r.compress = compress;
+	r.cache_dir = cache_dir;
+	r.upload_ms = upload_ms;
+	r.frame = 0;
+	r.resident_bytes = 0;
+	r.uploads = 0;
+	r.frame_uploads = 0;
+	r.evictions = 0;
+	for (i = 0; i < RESIDENCY_MAX_STAGING; i++)
+		r.staging[i].state = RESIDENCY_SLOT_FREE;
+	r.next_sequence = 0;
+
+	if (num_threads < 1)
+		num_threads = 1;
+	if (num_threads > RESIDENCY_MAX_THREADS)
+		num_threads = RESIDENCY_MAX_THREADS;
+	r.quit = false;
+	r.work = SDL_CreateSemaphore(0);
+	r.lock = SDL_CreateMutex();
+	for (r.num_threads = 0; r.num_threads < num_threads; r.num_threads++)
+		if ((r.threads[r.num_threads] = SDL_CreateThread(residency_worker, &r)) == NULL)
+			break;
+}
+
+/// \brief stops the workers and deletes all textures.
+void residency_free(residency_t & r)
+{
+	bitu32 i;
+	bit32 j;
+
+	SDL_mutexP(r.lock);
+	r.quit = true;
+	SDL_mutexV(r.lock);
+	for (j = 0; j < r.num_threads; j++)
+		SDL_SemPost(r.work);
+	for (j = 0; j < r.num_threads; j++)
+		SDL_WaitThread(r.threads[j], NULL);
+	r.num_threads = 0;
+	SDL_DestroySemaphore(r.work);
+	SDL_DestroyMutex(r.lock);
+
+	for (i = 0; i < RESIDENCY_MAX_STAGING; i++) {
+		residency_staging_t & slot = r.staging[i];
+
+		if (slot.state == RESIDENCY_SLOT_UPLOADING) {
+			GLuint name = r.first_texture + slot.tile;
+
+			qglDeleteTextures(1, &name);
+		}
+		slot.state = RESIDENCY_SLOT_FREE;
+		slot.pixels.resize(0);
+	}
+	for (i = 0; i < r.textures.size(); i++)
+		if (r.textures[i].resident) {
+			GLuint name = r.first_texture + i;
+
+			qglDeleteTextures(1, &name);
+			r.textures[i].resident = false;
+		}
+	r.num_queued = 0;
+	r.resident_bytes = 0;
+}
+
+/// \brief marks a tile as used in this frame, queues it if it is not resident.
+static void use_tile(residency_t & r, bitu32 tile)
+{
+	residency_texture_t & texture = r.textures[tile];
+
+	texture.last_used = r.frame;
+	if (!texture.resident && !texture.queued && !texture.staged) {
+		texture.queued = true;
+		r.queue[r.num_queued++] = tile;
+	}
+}
+
+/** \brief marks the textures of a room as used.
+  *
+  * Call it for every room that gets drawn, so the textures of a room which comes into view get
+  * queued together.
+  */
+void residency_use_room(residency_t & r, bitu32 room)
+{
+	bitu32 i;
+
+	for (i = r.room_tile_start[room]; i < r.room_tile_start[room + 1]; i++)
+		use_tile(r, r.room_tiles[i]);
+}
+
+/** \brief binds the texture of a tile.
+  *
+  * Binds no texture if the tile is VT_BATCH_COLOURED or not resident yet.
+  */
+void residency_bind(residency_t & r, bitu16 tile)
+{
+	if (tile == VT_BATCH_COLOURED) {
+		qglBindTexture(GL_TEXTURE_2D, 0);
+		return;
+	}
+	use_tile(r, tile);
+	if (r.textures[tile].resident)
+		qglBindTexture(GL_TEXTURE_2D, r.first_texture + tile);
+	else
+		qglBindTexture(GL_TEXTURE_2D, 0);
+}
+
+/** \brief evicts the least recently used texture that was not used in this frame.
+  *
+  * Returns false if there is none.
+  */
+static bool evict_one(residency_t & r)
+{
+	bitu32 i, oldest = r.textures.size();
+	GLuint name;
+
+	for (i = 0; i < r.textures.size(); i++) {
+		residency_texture_t & texture = r.textures[i];
+
+		if (!texture.resident || (texture.last_used == r.frame))
+			continue;
+		if ((oldest == r.textures.size()) || (texture.last_used < r.textures[oldest].last_used))
+			oldest = i;
+	}
+	if (oldest == r.textures.size())
+		return false;
+
+	name = r.first_texture + oldest;
+	qglDeleteTextures(1, &name);
+	r.textures[oldest].resident = false;
+	r.resident_bytes -= r.textures[oldest].bytes;
+	r.evictions++;
+	return true;
+}
+
+/** \brief scales an image up to twice its size with Scale2x.
+  *
+  * Edges between equal texels are kept sharp instead of being blurred, which suits the
+  * hand drawn textures. Only compares texels, so alpha is handled like the colour.
+  */
+static void scale2x(const bitu32 *src, bitu32 size, bitu32 *dst)
+{
+	bitu32 x, y;
+
+	for (y = 0; y < size; y++) {
+		const bitu32 *row = src + y * size;
+		const bitu32 *above = src + ((y > 0) ? y - 1 : y) * size;
+		const bitu32 *below = src + ((y + 1 < size) ? y + 1 : y) * size;
+		bitu32 *out = dst + y * 2 * size * 2;
+
+		for (x = 0; x < size; x++) {
+			bitu32 e = row[x];
+			bitu32 b = above[x];
+			bitu32 h = below[x];
+			bitu32 d = row[(x > 0) ? x - 1 : x];
+			bitu32 f = row[(x + 1 < size) ? x + 1 : x];
+
+			if ((b != h) && (d != f)) {
+				out[x * 2] = (d == b) ? d : e;
+				out[x * 2 + 1] = (b == f) ? f : e;
+				out[size * 2 + x * 2] = (d == h) ? d : e;
+				out[size * 2 + x * 2 + 1] = (h == f) ? f : e;
+			} else {
+				out[x * 2] = e;
+				out[x * 2 + 1] = e;
+				out[size * 2 + x * 2] = e;
+				out[size * 2 + x * 2 + 1] = e;
+			}
+		}
+	}
+}
+
+static void put32(bitu8 *p, bitu32 v)
+{
+	p[0] = (bitu8)v;
+	p[1] = (bitu8)(v >> 8);
+	p[2] = (bitu8)(v >> 16);
+	p[3] = (bitu8)(v >> 24);
+}
+
+static bitu32 get32(const bitu8 *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((bitu32)p[3] << 24);
+}
+
+/// \brief returns the file of a tile in the cache, free it with delete [].
+static char *cache_filename(residency_t & r, const bitu32 *src, bitu32 size)
+{
+	bitu8 options[2];
+	bitu32 hash;
+	char *filename;
+
+	options[0] = (bitu8)r.scale;
+	options[1] = r.mipmaps ? 1 : 0;
+	hash = bench_checksum(BENCH_CHECKSUM_INIT, (const bitu8 *)src, size * size * 4);
+	hash = bench_checksum(hash, options, sizeof(options));
+	filename = new char[strlen(r.cache_dir) + 16];
+	sprintf(filename, "%s/%08x.vtc", r.cache_dir, hash);
+
+	return filename;
+}
+
+/// \brief reads the blocks of a slot from the cache, returns false if the file is missing or does not fit.
+static bool cache_load(const char *filename, residency_texture_t & texture, residency_staging_t & slot)
+{
+	bitu8 header[RESIDENCY_CACHE_HEADER];
+	SDL_RWops *rw;
+	bool ok;
+
+	if ((rw = SDL_RWFromFile(filename, "rb")) == NULL)
+		return false;
+	ok = (SDL_RWread(rw, header, sizeof(header), 1) == 1) && (memcmp(header, RESIDENCY_CACHE_MAGIC, 4) == 0)
+	    && (get32(header + 4) == RESIDENCY_CACHE_VERSION) && (get32(header + 8) == (bitu32)texture.format)
+	    && (get32(header + 12) == slot.size) && (get32(header + 16) == slot.num_levels) && (get32(header + 20) == texture.bytes);
+	if (ok) {
+		slot.blocks.resize(texture.bytes);
+		ok = (SDL_RWread(rw, &slot.blocks[0], texture.bytes, 1) == 1);
+	}
+	SDL_RWclose(rw);
+
+	return ok;
+}
+
+/// \brief writes the blocks of a slot to the cache, a file that can't be written is left out.
+static void cache_save(const char *filename, residency_texture_t & texture, residency_staging_t & slot)
+{
+	bitu8 header[RESIDENCY_CACHE_HEADER];
+	SDL_RWops *rw;
+
+	if ((rw = SDL_RWFromFile(filename, "wb")) == NULL)
+		return;
+	memcpy(header, RESIDENCY_CACHE_MAGIC, 4);
+	put32(header + 4, RESIDENCY_CACHE_VERSION);
+	put32(header + 8, texture.format);
+	put32(header + 12, slot.size);
+	put32(header + 16, slot.num_levels);
+	put32(header + 20, texture.bytes);
+	SDL_RWwrite(rw, header, sizeof(header), 1);
+	SDL_RWwrite(rw, &slot.blocks[0], texture.bytes, 1);
+	SDL_RWclose(rw);
+}
+
+/** \brief fills the pixels or blocks of a staging slot, runs on a worker.
+  *
+  * Compressed textures come from the cache if it has them, the others get encoded from the
+  * pixels and added to the cache.
+  */
+static void prepare_staging(residency_t & r, residency_staging_t & slot)
+{
+	residency_texture_t & texture = r.textures[slot.tile];
+	char *filename = NULL;
+	const bitu32 *src;
+	bitu32 size, offset, i;
+
+	src = tile_pixels(*r.level, slot.tile, size);
+	slot.size = size * r.scale;
+	slot.num_levels = 1;
+	if (r.mipmaps)
+		for (i = slot.size; i > 1; i /= 2)
+			slot.num_levels++;
+	slot.next_level = 0;
+	slot.next_offset = 0;
+	slot.next_row = 0;
+
+	if ((texture.format != VT_DXT_NONE) && r.cache_dir) {
+		filename = cache_filename(r, src, size);
+		if (cache_load(filename, texture, slot)) {
+			delete [] filename;
+			return;
+		}
+	}
+
+	slot.pixels.resize(chain_texels(slot.size, r.mipmaps));
+	if (r.scale == 2)
+		scale2x(src, size, &slot.pixels[0]);
+	else
+		memcpy(&slot.pixels[0], src, size * size * 4);
+
+	// every level is made from the one before
+	for (i = 1, offset = 0, size = slot.size; i < slot.num_levels; i++, size /= 2) {
+		vt_downsample_rgba8(&slot.pixels[offset], size, &slot.pixels[offset + size * size]);
+		offset += size * size;
+	}
+
+	if (texture.format != VT_DXT_NONE) {
+		bitu32 bytes = 0;
+
+		slot.blocks.resize(texture.bytes);
+		for (i = 0, offset = 0, size = slot.size; i < slot.num_levels; i++, size /= 2) {
+			vt_dxt_encode(texture.format, &slot.pixels[offset], size, &slot.blocks[bytes]);
+			offset += size * size;
+			bytes += vt_dxt_size(texture.format, size);
+		}
+		slot.pixels.resize(0);
+		if (filename)
+			cache_save(filename, texture, slot);
+	}
+	delete [] filename;
+}
+
+/// \brief returns the slot in state with the lowest sequence, NULL if there is none. Lock first.
+static residency_staging_t *find_slot(residency_t & r, residency_slot_e state)
+{
+	residency_staging_t *found = NULL;
+	int i;
+
+	for (i = 0; i < RESIDENCY_MAX_STAGING; i++)
+		if ((r.staging[i].state == state) && ((found == NULL) || ((bit32)(r.staging[i].sequence - found->sequence) < 0)))
+			found = &r.staging[i];
+
+	return found;
+}
+
+/// \brief prepares the requested slots until residency_free().
+static int residency_worker(void *data)
+{
+	residency_t & r = *(residency_t *) data;
+
+	for (;;) {
+		residency_staging_t *slot;
+
+		SDL_SemWait(r.work);
+		SDL_mutexP(r.lock);
+		if (r.quit) {
+			SDL_mutexV(r.lock);
+			break;
+		}
+		if ((slot = find_slot(r, RESIDENCY_SLOT_REQUESTED)) != NULL)
+			slot->state = RESIDENCY_SLOT_PREPARING;
+		SDL_mutexV(r.lock);
+
+		if (slot) {
+			prepare_staging(r, *slot);
+			SDL_mutexP(r.lock);
+			slot->state = RESIDENCY_SLOT_READY;
+			SDL_mutexV(r.lock);
+		}
+	}
+
+	return 0;
+}
+
+/** \brief uploads the next strip of a slot, allocates the texture first if needed.
+  *
+  * Returns true when the texture is complete.
+  */
+static bool upload_strip(residency_t & r, residency_staging_t & slot)
+{
+	residency_texture_t & texture = r.textures[slot.tile];
+	bitu32 size = slot.size >> slot.next_level;
+	bitu32 rows, i;
+
+	qglBindTexture(GL_TEXTURE_2D, r.first_texture + slot.tile);
+	if (slot.state == RESIDENCY_SLOT_READY) {
+		if (r.budget > 0)
+			while ((r.resident_bytes + texture.bytes > r.budget) && evict_one(r)) ;
+		if (texture.format == VT_DXT_NONE)
+			for (i = 0; i < slot.num_levels; i++)
+				qglTexImage2D(GL_TEXTURE_2D, i, GL_RGBA, slot.size >> i, slot.size >> i, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		if (r.level->atlas.pages.empty()) {
+			qglTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+			qglTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		} else {
+			qglTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+			qglTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+		}
+		qglTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		if (slot.num_levels > 1) {
+			qglTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+			if (!r.level->atlas.pages.empty()) {
+				bitu32 max_level = 0;
+
+				// beyond this the textiles of an atlas page bleed into each other
+				while ((max_level + 1 < slot.num_levels) && ((r.level->atlas.padding * r.scale) >> (max_level + 1)) >= 1)
+					max_level++;
+				qglTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, max_level);
+			}
+		} else
+			qglTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		r.resident_bytes += texture.bytes;
+		slot.state = RESIDENCY_SLOT_UPLOADING;	// only this thread uses UPLOADING slots
+	}
+
+	// compressed levels go up whole, they can't be allocated empty and filled in strips everywhere
+	if (texture.format != VT_DXT_NONE) {
+		bitu32 bytes = vt_dxt_size(texture.format, size);
+
+		qglCompressedTexImage2DARB(GL_TEXTURE_2D, slot.next_level, (texture.format == VT_DXT_BC1) ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT,
+					   size, size, 0, bytes, &slot.blocks[slot.next_offset]);
+		slot.next_offset += bytes;
+		slot.next_level++;
+		return slot.next_level >= slot.num_levels;
+	}
+
+	rows = size - slot.next_row;
+	if (rows > RESIDENCY_UPLOAD_ROWS)
+		rows = RESIDENCY_UPLOAD_ROWS;
+	qglTexSubImage2D(GL_TEXTURE_2D, slot.next_level, 0, slot.next_row, size, rows, GL_RGBA, GL_UNSIGNED_BYTE, &slot.pixels[slot.next_offset + slot.next_row * size]);
+	slot.next_row += rows;
+	if (slot.next_row >= size) {
+		slot.next_offset += size * size;
+		slot.next_level++;
+		slot.next_row = 0;
+	}
+
+	return slot.next_level >= slot.num_levels;
+}
+
+/** \brief moves the textures on, call it once at the end of every frame.
+  *
+  * Queued textures which were used in this frame get a staging slot, the others are dropped
+  * from the queue and get queued again when they are needed. Then prepared textures get
+  * uploaded until upload_ms are used up.
+  */
+void residency_update(residency_t & r)
+{
+	double start = bench_time();
+	bitu32 uploads = r.uploads;
+	bitu32 kept = 0;
+	bitu32 i;
+	int j;
+
+	SDL_mutexP(r.lock);
+	for (i = 0; i < r.num_queued; i++) {
+		bitu32 tile = r.queue[i];
+		residency_texture_t & texture = r.textures[tile];
+
+		if (texture.last_used != r.frame) {
+			texture.queued = false;
+			continue;
+		}
+		for (j = 0; j < RESIDENCY_MAX_STAGING; j++)
+			if (r.staging[j].state == RESIDENCY_SLOT_FREE)
+				break;
+		if (j == RESIDENCY_MAX_STAGING) {
+			r.queue[kept++] = tile;
+			continue;
+		}
+		r.staging[j].state = RESIDENCY_SLOT_REQUESTED;
+		r.staging[j].tile = tile;
+		r.staging[j].sequence = r.next_sequence++;
+		texture.queued = false;
+		texture.staged = true;
+		if (r.num_threads > 0)
+			SDL_SemPost(r.work);
+	}
+	r.num_queued = kept;
+	SDL_mutexV(r.lock);
+
+	// without workers the textures get prepared here
+	if (r.num_threads == 0)
+		for (j = 0; j < RESIDENCY_MAX_STAGING; j++)
+			if (r.staging[j].state == RESIDENCY_SLOT_REQUESTED) {
+				prepare_staging(r, r.staging[j]);
+				r.staging[j].state = RESIDENCY_SLOT_READY;
+			}
+
+	for (;;) {
+		residency_staging_t *slot;
+
+		SDL_mutexP(r.lock);
+		if ((slot = find_slot(r, RESIDENCY_SLOT_UPLOADING)) == NULL)
+			slot = find_slot(r, RESIDENCY_SLOT_READY);
+		SDL_mutexV(r.lock);
+		if (slot == NULL)
+			break;
+
+		if (upload_strip(r, *slot)) {
+			r.textures[slot->tile].resident = true;
+			r.textures[slot->tile].staged = false;
+			r.uploads++;
+			slot->pixels.resize(0);
+			slot->blocks.resize(0);
+			SDL_mutexP(r.lock);
+			slot->state = RESIDENCY_SLOT_FREE;
+			SDL_mutexV(r.lock);
+		}
+		if (bench_time() - start >= r.upload_ms)
+			break;
+	}
+	r.frame_uploads = r.uploads - uploads;
+	r.frame++;
+}
+
+/** \brief returns true while the textures in view are not all shown yet.
+  *
+  * That is while textures are queued or staged, or were uploaded by the last
+  * residency_update() and not drawn since. Keep drawing frames until it returns false, even
+  * if the camera does not move.
+  */
+bool residency_pending(residency_t & r)
+{
+	bool pending = (r.num_queued > 0) || (r.frame_uploads > 0);
+	int i;
+
+	SDL_mutexP(r.lock);
+	for (i = 0; i < RESIDENCY_MAX_STAGING; i++)
+		if (r.staging[i].state != RESIDENCY_SLOT_FREE)
+			pending = true;
+	SDL_mutexV(r.lock);
+
+	return pending;
+}
+
+/** \brief uploads all textures at once.
+  *
+  * Runs residency_update() with no time limit until every texture is resident. All textures
+  * count as used meanwhile, so the budget gets exceeded if they do not fit.
+  */
+void residency_load_all(residency_t & r)
+{
+	double upload_ms = r.upload_ms;
+	bitu32 i, uploads;
+	bool done = false;
+
+	r.upload_ms = 1e30;
+	while (!done) {
+		done = true;
+		for (i = 0; i < r.textures.size(); i++) {
+			use_tile(r, i);
+			if (!r.textures[i].resident)
+				done = false;
+		}
+		uploads = r.uploads;
+		residency_update(r);
+		if ((r.uploads == uploads) && (r.num_threads > 0))
+			SDL_Delay(1);	// the workers are still preparing
+	}
+	r.upload_ms = upload_ms;
+}
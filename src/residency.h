@@ -0,0 +1,98 @@
+#ifndef _RESIDENCY_H_
+#define _RESIDENCY_H_
+
+#include "SDL.h"
+#include "dyngl.h"
+#include "vt_level.h"
+#include "vt_dxt.h"
+
+#define RESIDENCY_MAX_STAGING 8	///< \brief textures being prepared or uploaded at the same time.
+#define RESIDENCY_UPLOAD_ROWS 32	///< \brief rows per qglTexSubImage2D call.
+#define RESIDENCY_MAX_THREADS 8	///< \brief upper limit of the workers.
+
+/// \brief Texture of the residency manager, one per textile or atlas page.
+typedef struct {
+	vt_dxt_format_e format;	///< \brief how the texture is stored in OpenGL.
+	bitu32 bytes;		///< \brief memory the uploaded texture takes.
+	bitu32 last_used;	///< \brief residency_t::frame of the last residency_bind() or residency_use_room().
+	bool resident;		///< \brief uploaded and not evicted.
+	bool queued;		///< \brief waiting in residency_t::queue.
+	bool staged;		///< \brief has a residency_t::staging slot.
+} residency_texture_t;
+typedef prtl::array < residency_texture_t > residency_texture_array_t;
+
+/// \brief State of a staging slot, the worker only touches REQUESTED and PREPARING slots.
+typedef enum {
+	RESIDENCY_SLOT_FREE,
+	RESIDENCY_SLOT_REQUESTED,	///< \brief waits for the worker.
+	RESIDENCY_SLOT_PREPARING,	///< \brief the worker fills pixels.
+	RESIDENCY_SLOT_READY,	///< \brief pixels are done, waits for the upload.
+	RESIDENCY_SLOT_UPLOADING	///< \brief texture is allocated, next_row and on are missing.
+} residency_slot_e;
+
+/// \brief Texture on its way from the worker to OpenGL.
+typedef struct {
+	residency_slot_e state;	///< \brief guarded by residency_t::lock.
+	bitu32 tile;		///< \brief tile the texture is for.
+	bitu32 sequence;	///< \brief slots get prepared and uploaded in request order.
+	bitu32 size;		///< \brief width and height of mipmap level 0.
+	bitu32 num_levels;	///< \brief mipmap levels in pixels.
+	bitu32_array_t pixels;	///< \brief RGBA8 texels of all levels, largest first, top row first.
+	bitu8_array_t blocks;	///< \brief compressed levels like pixels, empty for uncompressed textures.
+	bitu32 next_level;	///< \brief level which is being uploaded.
+	bitu32 next_offset;	///< \brief index of next_level in pixels, or byte offset in blocks.
+	bitu32 next_row;	///< \brief first row of next_level which is not uploaded yet.
+} residency_staging_t;
+
+/** \brief Uploads textures when they are first needed and evicts unused ones.
+  *
+  * Textures are the textiles, or the atlas pages if the level has an atlas; their OpenGL names
+  * are first_texture + tile like before. A texture which is not resident gets queued and its
+  * faces are drawn untextured until it is uploaded. residency_update() hands queued textures
+  * to the worker threads, which prepare them (optionally scaled up by scale, with the mipmap
+  * chain if mipmaps is set) in staging slots. The prepared textures get uploaded in strips of
+  * RESIDENCY_UPLOAD_ROWS rows until upload_ms of the frame are used up, at least one strip
+  * per frame. With compress set, opaque textures are stored as BC1 and the others as BC3;
+  * the workers encode them, or load them from cache_dir, and every mipmap level is one
+  * strip. Before a texture is allocated the
+  * least recently used textures get evicted while more than budget bytes are resident.
+  * Textures used in the current frame are never evicted, so the budget can be exceeded if a
+  * single frame needs more.
+  */
+typedef struct {
+	residency_texture_array_t textures;	///< \brief one per tile.
+	bitu32_array_t room_tile_start;	///< \brief rooms.size() + 1 offsets into room_tiles.
+	bitu32_array_t room_tiles;	///< \brief tiles of the geometry and static meshes of every room.
+	bitu32_array_t queue;	///< \brief tiles waiting for a staging slot, oldest first, num_queued are used.
+	bitu32 num_queued;	///< \brief used entries of queue.
+	VT_Level *level;	///< \brief level the textures come from.
+	GLuint first_texture;	///< \brief OpenGL name of tile 0.
+	bitu32 budget;		///< \brief bytes that may be resident, 0 for no limit.
+	bitu32 scale;		///< \brief 1, or 2 to scale the textures up.
+	bool mipmaps;		///< \brief build mipmaps and sample them trilinear.
+	bool compress;		///< \brief upload BC1/BC3 compressed textures.
+	const char *cache_dir;	///< \brief directory of compressed textures, NULL to encode them every time.
+	double upload_ms;	///< \brief upload time per frame.
+	bitu32 frame;		///< \brief counts residency_update() calls.
+	bitu32 resident_bytes;	///< \brief bytes of the resident textures.
+	bitu32 uploads;		///< \brief textures uploaded so far.
+	bitu32 frame_uploads;	///< \brief textures uploaded by the last residency_update().
+	bitu32 evictions;	///< \brief textures evicted so far.
+	residency_staging_t staging[RESIDENCY_MAX_STAGING];	///< \brief textures being prepared or uploaded.
+	bitu32 next_sequence;	///< \brief residency_staging_t::sequence of the next request.
+	bit32 num_threads;	///< \brief workers, 0 if none could be started, then residency_update() prepares.
+	SDL_Thread *threads[RESIDENCY_MAX_THREADS];	///< \brief workers.
+	SDL_sem *work;		///< \brief posted once per requested slot and once per worker to quit.
+	SDL_mutex *lock;	///< \brief protects the slot states and quit.
+	bool quit;		///< \brief tells the worker to exit.
+} residency_t;
+
+void residency_init(residency_t & r, VT_Level & level, GLuint first_texture, bitu32 budget, bitu32 scale, bool mipmaps, bool compress, const char *cache_dir, double upload_ms, bit32 num_threads);
+void residency_free(residency_t & r);
+void residency_load_all(residency_t & r);
+void residency_use_room(residency_t & r, bitu32 room);
+void residency_bind(residency_t & r, bitu16 tile);
+void residency_update(residency_t & r);
+bool residency_pending(residency_t & r);
+
+#endif // _RESIDENCY_H_
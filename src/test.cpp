@@ -30,126 +30,268 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <math.h>
-#include <hash_set>
+#include <vector>
+#include <algorithm>
 #include "SDL.h"
 #include "dyngl.h"
 #include "vt_level.h"
 #include "scaler.h"
 #include "glmath.h"
 #include "util.h"
+#include "bench.h"
+#include "vt_raster.h"
+#include "replay.h"
+#include "perf.h"
+#include "vt_dxt.h"
+#include "residency.h"
 
 #define RCSID "$Id: test.cpp,v 1.17 2002/09/20 15:59:02 crow Exp $"
 
 static vec3_t pos;
+static ang3_t view_angles;
 static int current_room = 0;
+static bool room_override = false;	///< \brief PageUp/PageDown picked current_room, the camera doesn't move it until Home.
 static tr2_item_t *lara;
-
+static SDL_RWops *replay_in = NULL;	///< \brief input log the viewer plays back, NULL for live input.
+static SDL_RWops *replay_out = NULL;	///< \brief input log the viewer records to, NULL if not recording.
+static bitu32_array_t flyby_sequences;	///< \brief flyby sequences of the level.
+static bench_key_array_t flyby_keys;	///< \brief path of the flyby being played.
+static int flyby = -1;		///< \brief index into flyby_sequences of the flyby being played, -1 for none.
+static float flyby_t;		///< \brief position on flyby_keys.
+static bool start_flyby = false;	///< \brief -flyby was given, the next live frame gets a press of F so it is recorded.
+
+#define VIEW_FOVY 90.0		///< \brief vertical field of view in degrees.
+#define VIEW_ASPECT 1.3333	///< \brief width / height of the view.
+#define VIEW_WIDTH 640		///< \brief width of the window and the offscreen buffer.
+#define VIEW_HEIGHT 480		///< \brief height of the window and the offscreen buffer.
+#define BENCH_FRAMES_PER_KEY 60	///< \brief default benchmark length.
+#define MAX_CLIP_NORMALS 17	///< \brief planes of a frustum, including the view direction.
+#define MAX_PORTAL_VERTICES (4 + MAX_CLIP_NORMALS)	///< \brief corners of a clipped portal.
+#define PORTAL_EPSILON 1.0f	///< \brief camera distance below which a portal counts as open.
+#define MAX_VISITS_PER_ROOM 8	///< \brief traversal budget, see draw_visible_rooms.
+
+/** \brief Planes through the camera.
+  *
+  * A point p is inside if clip_normals[i].dot(p - pos) >= 0 for all planes. Plane 0 is the
+  * view direction.
+  */
 typedef struct {
-	vec3_t clip_normals[5];
+	vec3_t clip_normals[MAX_CLIP_NORMALS];
+	int num_clip_normals;
 } frustum_t;
 
-void draw_tr4_mesh(VT_Level &level, tr4_mesh_t * mesh, int intensity)
-{
-	int i;
+#define ATLAS_TEXTURE_BASE 128	///< \brief texture id of the first atlas page.
 
-	assert(mesh);
+static int draw_calls;		///< \brief qglDrawRangeElements calls of the current frame.
 
-	if (intensity >= 0)
-		qglColor4f((float)intensity / 32768.0f, (float)intensity / 32768.0f, (float)intensity / 32768.0f, 1.0f);
-	else
-		qglColor4f(1.0f, 1.0f, 1.0f, 1.0f);
-	for (i = 0; i < mesh->num_textured_rectangles; i++) {
-		tr4_face4_t *face = &mesh->textured_rectangles[i];
-		tr4_object_texture_t *tex = &level.object_textures[face->texture & 0x0fff];
-		tr4_object_texture_vert_t *tex_vert;
+#define MAX_MATRIX_DEPTH 32	///< \brief modelview stack depth of the software renderer.
 
-		qglBindTexture(GL_TEXTURE_2D, (tex->tile & 0x0fff) + 1);
+static vt_raster_t *raster = NULL;	///< \brief software renderer, NULL when drawing with OpenGL.
+static float raster_projection[16];	///< \brief projection matrix of the software renderer.
+static float raster_modelview[MAX_MATRIX_DEPTH][16];	///< \brief modelview stack of the software renderer.
+static int raster_matrix;	///< \brief top of raster_modelview.
+
+/// \brief glPushMatrix for the current renderer.
+static void scene_push_matrix()
+{
+	if (!raster) {
+		qglPushMatrix();
+		return;
+	}
+	assert(raster_matrix + 1 < MAX_MATRIX_DEPTH);
+	memcpy(raster_modelview[raster_matrix + 1], raster_modelview[raster_matrix], sizeof(raster_modelview[0]));
+	raster_matrix++;
+}
 
-		qglBegin(GL_QUADS);
-		tex_vert = &tex->vertices[0];
-		qglTexCoord2f(((float)tex_vert->xpixel + (float)tex_vert->xcoordinate * 0.5f) / 256.0f, ((float)tex_vert->ypixel + (float)tex_vert->ycoordinate * 0.5f) / 256.0f);
-		qglVertex3fv((GLfloat *) & mesh->vertices[face->vertices[0]]);
+/// \brief glPopMatrix for the current renderer.
+static void scene_pop_matrix()
+{
+	if (!raster) {
+		qglPopMatrix();
+		return;
+	}
+	assert(raster_matrix > 0);
+	raster_matrix--;
+}
 
-		tex_vert = &tex->vertices[1];
-		qglTexCoord2f(((float)tex_vert->xpixel + (float)tex_vert->xcoordinate * 0.5f) / 256.0f, ((float)tex_vert->ypixel + (float)tex_vert->ycoordinate * 0.5f) / 256.0f);
-		qglVertex3fv((GLfloat *) & mesh->vertices[face->vertices[1]]);
+/// \brief glTranslatef for the current renderer.
+static void scene_translate(float x, float y, float z)
+{
+	if (raster)
+		vt_matrix_translate(raster_modelview[raster_matrix], x, y, z);
+	else
+		qglTranslatef(x, y, z);
+}
 
-		tex_vert = &tex->vertices[2];
-		qglTexCoord2f(((float)tex_vert->xpixel + (float)tex_vert->xcoordinate * 0.5f) / 256.0f, ((float)tex_vert->ypixel + (float)tex_vert->ycoordinate * 0.5f) / 256.0f);
-		qglVertex3fv((GLfloat *) & mesh->vertices[face->vertices[2]]);
+/// \brief glRotatef for the current renderer.
+static void scene_rotate(float angle, float x, float y, float z)
+{
+	if (raster)
+		vt_matrix_rotate(raster_modelview[raster_matrix], angle, x, y, z);
+	else
+		qglRotatef(angle, x, y, z);
+}
 
-		tex_vert = &tex->vertices[3];
-		qglTexCoord2f(((float)tex_vert->xpixel + (float)tex_vert->xcoordinate * 0.5f) / 256.0f, ((float)tex_vert->ypixel + (float)tex_vert->ycoordinate * 0.5f) / 256.0f);
-		qglVertex3fv((GLfloat *) & mesh->vertices[face->vertices[3]]);
-		qglEnd();
+/// \brief returns the pixels and the size of the texture of a batch, NULL for untextured batches.
+static const bitu32 *get_batch_texture(VT_Level &level, bitu16 tile, bitu32 &size)
+{
+	if (tile == VT_BATCH_COLOURED) {
+		size = 0;
+		return NULL;
 	}
-	for (i = 0; i < mesh->num_textured_triangles; i++) {
-		tr4_face3_t *face = &mesh->textured_triangles[i];
-		tr4_object_texture_t *tex = &level.object_textures[face->texture & 0x0fff];
-		tr4_object_texture_vert_t *tex_vert;
-
-		qglBindTexture(GL_TEXTURE_2D, (tex->tile & 0x0fff) + 1);
+	if (level.atlas.pages.empty()) {
+		size = 256;
+		return &level.textile32[tile].pixels[0][0];
+	}
+	size = level.atlas.page_size;
+	return &level.atlas.pages[tile][0];
+}
 
-		qglBegin(GL_TRIANGLES);
-		tex_vert = &tex->vertices[0];
-		qglTexCoord2f(((float)tex_vert->xpixel + (float)tex_vert->xcoordinate * 0.5f) / 256.0f, ((float)tex_vert->ypixel + (float)tex_vert->ycoordinate * 0.5f) / 256.0f);
-		qglVertex3fv((GLfloat *) & mesh->vertices[face->vertices[0]]);
+/// \brief hands the batches of a mesh to the software renderer, see draw_batched_mesh.
+static void raster_batched_mesh(VT_Level &level, vt_batched_mesh_t &mesh, const GLfloat *colour)
+{
+	float matrix[16];
+	bitu32 i;
 
-		tex_vert = &tex->vertices[1];
-		qglTexCoord2f(((float)tex_vert->xpixel + (float)tex_vert->xcoordinate * 0.5f) / 256.0f, ((float)tex_vert->ypixel + (float)tex_vert->ycoordinate * 0.5f) / 256.0f);
-		qglVertex3fv((GLfloat *) & mesh->vertices[face->vertices[1]]);
+	vt_matrix_multiply(matrix, raster_projection, raster_modelview[raster_matrix]);
+	for (i = 0; i < mesh.batches.size(); i++) {
+		vt_batch_t &batch = mesh.batches[i];
+		const bitu32 *texture;
+		bitu32 size;
 
-		tex_vert = &tex->vertices[2];
-		qglTexCoord2f(((float)tex_vert->xpixel + (float)tex_vert->xcoordinate * 0.5f) / 256.0f, ((float)tex_vert->ypixel + (float)tex_vert->ycoordinate * 0.5f) / 256.0f);
-		qglVertex3fv((GLfloat *) & mesh->vertices[face->vertices[2]]);
-		qglEnd();
+		texture = get_batch_texture(level, batch.tile, size);
+		draw_calls++;
+		vt_raster_draw_batch(*raster, matrix, mesh, batch, texture, size, colour);
 	}
-	for (i = 0; i < mesh->num_coloured_rectangles; i++) {
-		tr4_face4_t *face = &mesh->coloured_rectangles[i];
-		int col = face->texture & 0xff;
+}
 
-		qglColor3f(level.palette.colour[col].r, level.palette.colour[col].g, level.palette.colour[col].b);
+static residency_t *residency = NULL;	///< \brief uploads the textures, NULL with the software renderer.
 
-		qglBindTexture(GL_TEXTURE_2D, 0);
+/// \brief binds the texture of a batch.
+static void bind_batch_texture(VT_Level &level, bitu16 tile)
+{
+	if (residency)
+		residency_bind(*residency, tile);
+}
 
-		qglBegin(GL_QUADS);
-		qglVertex3fv((GLfloat *) & mesh->vertices[face->vertices[0]]);
-		qglVertex3fv((GLfloat *) & mesh->vertices[face->vertices[1]]);
-		qglVertex3fv((GLfloat *) & mesh->vertices[face->vertices[2]]);
-		qglVertex3fv((GLfloat *) & mesh->vertices[face->vertices[3]]);
-		qglEnd();
+/** \brief draws batched geometry from vertex arrays.
+  *
+  * One texture bind and one qglDrawRangeElements per batch. If colour is not NULL the textured
+  * batches get drawn with it instead of the vertex colours. The current colour is undefined
+  * afterwards.
+  */
+static void draw_batched_mesh(VT_Level &level, vt_batched_mesh_t &mesh, const GLfloat *colour)
+{
+	vt_batch_vertex_t *vertices;
+	bool colour_array = (colour == NULL);
+	bitu32 i;
+
+	if (mesh.batches.empty())
+		return;
+	if (raster) {
+		raster_batched_mesh(level, mesh, colour);
+		return;
 	}
-	for (i = 0; i < mesh->num_coloured_triangles; i++) {
-		tr4_face3_t *face = &mesh->coloured_triangles[i];
-		int col = face->texture & 0xff;
+	vertices = &mesh.vertices[0];
 
-		qglColor3f(level.palette.colour[col].r, level.palette.colour[col].g, level.palette.colour[col].b);
+	qglEnableClientState(GL_VERTEX_ARRAY);
+	qglEnableClientState(GL_TEXTURE_COORD_ARRAY);
+	if (colour_array)
+		qglEnableClientState(GL_COLOR_ARRAY);
+	else
+		qglColor4fv(colour);
+	qglVertexPointer(3, GL_FLOAT, sizeof(vt_batch_vertex_t), vertices->position);
+	qglTexCoordPointer(2, GL_FLOAT, sizeof(vt_batch_vertex_t), vertices->uv);
+	qglColorPointer(4, GL_UNSIGNED_BYTE, sizeof(vt_batch_vertex_t), &vertices->colour.r);
+	for (i = 0; i < mesh.batches.size(); i++) {
+		vt_batch_t &batch = mesh.batches[i];
+
+		if (!colour_array && (batch.tile == VT_BATCH_COLOURED)) {
+			qglEnableClientState(GL_COLOR_ARRAY);
+			colour_array = true;
+		}
+		bind_batch_texture(level, batch.tile);
+		draw_calls++;
+		qglDrawRangeElements(GL_TRIANGLES, batch.min_vertex, batch.max_vertex, batch.num_indices, GL_UNSIGNED_INT, &mesh.indices[batch.first_index]);
+	}
+	if (colour_array)
+		qglDisableClientState(GL_COLOR_ARRAY);
+	qglDisableClientState(GL_TEXTURE_COORD_ARRAY);
+	qglDisableClientState(GL_VERTEX_ARRAY);
+}
 
-		qglBindTexture(GL_TEXTURE_2D, 0);
+void draw_tr4_mesh(VT_Level &level, bitu32 mesh, int intensity)
+{
+	GLfloat colour[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
 
-		qglBegin(GL_TRIANGLES);
-		qglVertex3fv((GLfloat *) & mesh->vertices[face->vertices[0]]);
-		qglVertex3fv((GLfloat *) & mesh->vertices[face->vertices[1]]);
-		qglVertex3fv((GLfloat *) & mesh->vertices[face->vertices[2]]);
-		qglEnd();
-	}
+	if (intensity >= 0)
+		colour[0] = colour[1] = colour[2] = (float)intensity / 32768.0f;
+	draw_batched_mesh(level, level.mesh_batches[mesh], colour);
 }
 
 void draw_staticmesh(VT_Level &level, tr_staticmesh_t * mesh, int intensity)
 {
 	assert(mesh);
-	DBG(qglBindTexture(GL_TEXTURE_2D, 0); qglColor4f(1.0f, 1.0f, 0.0f, 1.0f); draw_box(mesh->visibility_box[0], mesh->visibility_box[1], false); draw_marker(mesh->visibility_box[0], 32, false); qglColor4f(1.0f, 0.0f, 0.0f, 1.0f); draw_marker(mesh->visibility_box[1], 32, false); qglColor4f(0.0f, 1.0f, 0.0f, 1.0f); draw_box(mesh->collision_box[0], mesh->collision_box[1], false); draw_marker(mesh->collision_box[0], 32, false); qglColor4f(0.0f, 0.0f, 1.0f, 1.0f); draw_marker(mesh->collision_box[1], 32, false););	// DBG
-	draw_tr4_mesh(level, &level.meshes[level.mesh_indices[mesh->mesh]], intensity);
+	DBG(if (!raster) { qglBindTexture(GL_TEXTURE_2D, 0); qglColor4f(1.0f, 1.0f, 0.0f, 1.0f); draw_box(mesh->visibility_box[0], mesh->visibility_box[1], false); draw_marker(mesh->visibility_box[0], 32, false); qglColor4f(1.0f, 0.0f, 0.0f, 1.0f); draw_marker(mesh->visibility_box[1], 32, false); qglColor4f(0.0f, 1.0f, 0.0f, 1.0f); draw_box(mesh->collision_box[0], mesh->collision_box[1], false); draw_marker(mesh->collision_box[0], 32, false); qglColor4f(0.0f, 0.0f, 1.0f, 1.0f); draw_marker(mesh->collision_box[1], 32, false);});	// DBG
+	draw_tr4_mesh(level, level.mesh_indices[mesh->mesh], intensity);
+}
+
+/** \brief tests if a box can be seen.
+  *
+  * The box is given in object space, the object is rotated by angle degrees around y and moved
+  * to origin, like qglTranslatef followed by qglRotatef does it. Returns false only if the box is
+  * completely outside of one of the frustum planes.
+  */
+static bool box_in_frustum(const frustum_t &frustum, const vec3_t &min, const vec3_t &max, const vec3_t &origin, float angle)
+{
+	vec_t c = (vec_t)cos(angle * M_PI / 180.0);
+	vec_t s = (vec_t)sin(angle * M_PI / 180.0);
+	vec3_t half = (max - min) * 0.5f;
+	vec3_t centre = (min + max) * 0.5f;
+	// the object axes in world space
+	vec3_t axis_x(c, 0.0f, -s);
+	vec3_t axis_z(s, 0.0f, c);
+	vec3_t world = origin + axis_x * centre.x + vec3_t(0.0f, centre.y, 0.0f) + axis_z * centre.z - pos;
+	int i;
+
+	for (i = 0; i < frustum.num_clip_normals; i++) {
+		const vec3_t &n = frustum.clip_normals[i];
+		vec_t radius = half.x * fabs(n.dot(axis_x)) + half.y * fabs(n.y) + half.z * fabs(n.dot(axis_z));
+
+		if (n.dot(world) + radius < 0)
+			return false;
+	}
+
+	return true;
 }
 
-void draw_room_staticmesh(VT_Level &level, tr2_room_staticmesh_t * mesh)
+static int static_meshes_drawn;
+static int items_drawn;
+
+void draw_room_staticmesh(VT_Level &level, tr2_room_staticmesh_t * mesh, const frustum_t &frustum)
 {
+	tr_staticmesh_t *staticmesh;
+
 	assert(mesh);
-	qglPushMatrix();
-	qglTranslatef(mesh->pos.x, mesh->pos.y, mesh->pos.z);
-	qglRotatef(mesh->rotation, 0.0f, 1.0f, 0.0f);
-	draw_staticmesh(level, level.find_staticmesh_id(mesh->object_id), mesh->intensity1);
-	qglPopMatrix();
+	staticmesh = level.find_staticmesh_id(mesh->object_id);
+	if (staticmesh != NULL) {
+		// the corners are not ordered after the y and z flip
+		vec3_t min, max;
+		int k;
+
+		for (k = 0; k < 3; k++) {
+			min[k] = std::min(staticmesh->visibility_box[0][k], staticmesh->visibility_box[1][k]);
+			max[k] = std::max(staticmesh->visibility_box[0][k], staticmesh->visibility_box[1][k]);
+		}
+		if (!box_in_frustum(frustum, min, max, mesh->pos, mesh->rotation))
+			return;
+	}
+	static_meshes_drawn++;
+	scene_push_matrix();
+	scene_translate(mesh->pos.x, mesh->pos.y, mesh->pos.z);
+	scene_rotate(mesh->rotation, 0.0f, 1.0f, 0.0f);
+	draw_staticmesh(level, staticmesh, mesh->intensity1);
+	scene_pop_matrix();
 }
 
 void draw_room_portal(VT_Level &level, tr_room_portal_t & portal)
@@ -184,218 +326,255 @@ void draw_room_portal(VT_Level &level, tr_room_portal_t & portal)
 	qglEnd();
 }
 
-static bitu8 *room_drawn;
 static int rooms_drawn;
 static int rooms_visited;
-static std::hash_set<int> room_stack;
+static bitu32_array_t room_drawn;	///< \brief one bit per room, set once the room was drawn this frame.
+static bitu32_array_t room_on_path;	///< \brief one bit per room, set while the traversal is inside the room.
 
-void draw_room(VT_Level &level, int room_num, frustum_t frustum)
+static inline bool test_room_bit(bitu32_array_t &bits, bitu32 room)
 {
-	tr5_room_t &room = level.rooms[room_num];
-	bitu32 i;
-#if 1
-	frustum_t new_frustum;
+	return ((bits[room >> 5] >> (room & 31)) & 1) != 0;
+}
 
-	rooms_visited++;
+static inline void set_room_bit(bitu32_array_t &bits, bitu32 room, bool value)
+{
+	if (value)
+		bits[room >> 5] |= 1 << (room & 31);
+	else
+		bits[room >> 5] &= ~(1 << (room & 31));
+}
 
-	if (room_stack.count(room_num))
-		return;
-	room_stack.insert(room_num);
-
-	for (i = 0; i < room.portals.size(); i++) {
-		vec3_t tempvec[4];
-		vec_t dist1;
-		vec_t dist2;
-
-		tempvec[0] = room.portals[i].vertices[0] + room.offset - pos;
-		tempvec[1] = room.portals[i].vertices[1] + room.offset - pos;
-		tempvec[2] = room.portals[i].vertices[2] + room.offset - pos;
-		tempvec[3] = room.portals[i].vertices[3] + room.offset - pos;
-
-		// 0
-		dist1 = frustum.clip_normals[0].dot(tempvec[0]);
-		dist2 = frustum.clip_normals[0].dot(tempvec[2]);
-		if ((dist1 < 0) && (dist2 < 0))
-			continue;
+/** \brief clips a convex polygon against a plane through the camera.
+  *
+  * Keeps the part on the positive side and returns the number of vertices written to out,
+  * which is at most count + 1.
+  */
+static int clip_polygon(const vec3_t *in, int count, const vec3_t &normal, vec3_t *out)
+{
+	int num = 0;
+	int i;
 
-		// 1
-		dist1 = frustum.clip_normals[1].dot(tempvec[0]);
-		dist2 = frustum.clip_normals[1].dot(tempvec[2]);
-		if ((dist1 < 0) && (dist2 < 0)) // not visible
-			break;
-		if ((dist1 >= 0) && (dist2 >= 0)) { // fully visible
-			new_frustum.clip_normals[1] = tempvec[0].cross(tempvec[1]);
-			new_frustum.clip_normals[1].normalize();
-		} else // partly visible
-			new_frustum.clip_normals[1] = frustum.clip_normals[1];
-
-		// 2
-		dist1 = frustum.clip_normals[2].dot(tempvec[0]);
-		dist2 = frustum.clip_normals[2].dot(tempvec[2]);
-		if ((dist1 < 0) && (dist2 < 0)) // not visible
-			break;
-		if ((dist1 >= 0) && (dist2 >= 0)) { // fully visible
-			new_frustum.clip_normals[2] = tempvec[1].cross(tempvec[2]);
-			new_frustum.clip_normals[2].normalize();
-		} else // partly visible
-			new_frustum.clip_normals[2] = frustum.clip_normals[2];
-
-		// 3
-		dist1 = frustum.clip_normals[3].dot(tempvec[0]);
-		dist2 = frustum.clip_normals[3].dot(tempvec[2]);
-		if ((dist1 < 0) && (dist2 < 0)) // not visible
-			break;
-		if ((dist1 >= 0) && (dist2 >= 0)) { // fully visible
-			new_frustum.clip_normals[3] = tempvec[2].cross(tempvec[3]);
-			new_frustum.clip_normals[3].normalize();
-		} else // partly visible
-			new_frustum.clip_normals[3] = frustum.clip_normals[3];
-
-		// 4
-		dist1 = frustum.clip_normals[4].dot(tempvec[0]);
-		dist2 = frustum.clip_normals[4].dot(tempvec[2]);
-		if ((dist1 < 0) && (dist2 < 0)) // not visible
-			break;
-		if ((dist1 >= 0) && (dist2 >= 0)) { // fully visible
-			new_frustum.clip_normals[4] = tempvec[3].cross(tempvec[0]);
-			new_frustum.clip_normals[4].normalize();
-		} else // partly visible
-			new_frustum.clip_normals[4] = frustum.clip_normals[4];
+	for (i = 0; i < count; i++) {
+		const vec3_t &a = in[i];
+		const vec3_t &b = in[(i + 1) % count];
+		vec_t da = normal.dot(a);
+		vec_t db = normal.dot(b);
 
-		new_frustum.clip_normals[0] = frustum.clip_normals[0];
+		if (da >= 0)
+			out[num++] = a;
+		if ((da >= 0) != (db >= 0))
+			out[num++] = a + (b - a) * (da / (da - db));
+	}
 
-		draw_room(level, room.portals[i].adjoining_room, new_frustum);
-/*
-		bitu32 j;
-		vec3_t tempvec;
-		vec_t dist1;
-		vec_t dist2;
-		bool visible = true;
-
-		tempvec = room.portals[i].vertices[0] + room.offset - pos;
-		dist1 = frustum.clip_normals[0].dot(tempvec);
-		tempvec = room.portals[i].vertices[2] + room.offset - pos;
-		dist2 = frustum.clip_normals[0].dot(tempvec);
-		if ((dist1 < 0) && (dist2 < 0))
-			continue;
+	return num;
+}
 
-		for (j = 1; j < 5; j++) {
-			tempvec = room.portals[i].vertices[0] + room.offset - pos;
-			dist1 = frustum.clip_normals[j].dot(tempvec);
-			tempvec = room.portals[i].vertices[2] + room.offset - pos;
-			dist2 = frustum.clip_normals[j].dot(tempvec);
-			if ((dist1 < 0) && (dist2 < 0)) {
-				visible = false;
-				break;
-			}
-		}
-		if (visible == 0)
+/** \brief narrows a frustum to the part of a portal which is visible in it.
+  *
+  * The portal quad gets clipped against every plane of frustum. What is left defines the new
+  * frustum, one plane through the camera for each edge. Returns false if nothing is left or the
+  * portal faces away from the camera. When the camera touches the portal, or the clipped
+  * polygon has too many edges, frustum is passed on unchanged.
+  */
+static bool narrow_frustum(const frustum_t &frustum, vt_room_edge_t &edge, frustum_t &out)
+{
+	vec3_t poly[2][MAX_PORTAL_VERTICES];
+	vec3_t centre;
+	vec_t side = edge.normal.dot(pos) - edge.dist;
+	int count = 4;
+	int cur = 0;
+	int i;
+
+	// the normal points into the room the camera looks out of
+	if (side < -PORTAL_EPSILON)
+		return false;
+	if (side < PORTAL_EPSILON) {
+		out = frustum;
+		return true;
+	}
+
+	for (i = 0; i < 4; i++)
+		poly[0][i] = edge.vertices[i] - pos;
+	for (i = 0; i < frustum.num_clip_normals; i++) {
+		count = clip_polygon(poly[cur], count, frustum.clip_normals[i], poly[cur ^ 1]);
+		cur ^= 1;
+		if (count < 3)
+			return false;
+	}
+	if (count >= MAX_CLIP_NORMALS) {
+		out = frustum;
+		return true;
+	}
+
+	for (i = 0; i < count; i++)
+		centre += poly[cur][i];
+	centre /= (vec_t)count;
+
+	out.clip_normals[0] = frustum.clip_normals[0];
+	out.num_clip_normals = 1;
+	for (i = 0; i < count; i++) {
+		vec3_t normal = poly[cur][i].cross(poly[cur][(i + 1) % count]);
+
+		// edges in line with the camera do not clip anything
+		if (normal.dot(normal) < 1e-6f)
 			continue;
-		tempvec = room.portals[i].vertices[0] + room.offset - pos;
-		new_frustum.clip_normals[1] = tempvec.cross(room.portals[i].vertices[1] + room.offset - pos);
-		new_frustum.clip_normals[1].normalize();
-		tempvec = room.portals[i].vertices[1] + room.offset - pos;
-		new_frustum.clip_normals[2] = tempvec.cross(room.portals[i].vertices[2] + room.offset - pos);
-		new_frustum.clip_normals[2].normalize();
-		tempvec = room.portals[i].vertices[2] + room.offset - pos;
-		new_frustum.clip_normals[3] = tempvec.cross(room.portals[i].vertices[3] + room.offset - pos);
-		new_frustum.clip_normals[3].normalize();
-		tempvec = room.portals[i].vertices[3] + room.offset - pos;
-		new_frustum.clip_normals[4] = tempvec.cross(room.portals[i].vertices[0] + room.offset - pos);
-		new_frustum.clip_normals[4].normalize();
-		draw_room(level, room.portals[i].adjoining_room, new_frustum);
-*/
+		normal.normalize();
+		if (normal.dot(centre) < 0)
+			normal = -normal;
+		out.clip_normals[out.num_clip_normals++] = normal;
 	}
 
-	room_stack.erase(room_num);
+	return true;
+}
 
-	if (room_drawn[room_num])
+/// \brief builds the frustum of the view from the camera axes.
+static void get_view_frustum(const vec3_t &forward, const vec3_t &right, const vec3_t &up, frustum_t &frustum)
+{
+	vec_t tan_y = (vec_t)tan(VIEW_FOVY * M_PI / 360.0);
+	vec_t tan_x = tan_y * (vec_t)VIEW_ASPECT;
+	int i;
+
+	frustum.clip_normals[0] = forward;
+	frustum.clip_normals[1] = forward * tan_x + right;
+	frustum.clip_normals[2] = forward * tan_x - right;
+	frustum.clip_normals[3] = forward * tan_y + up;
+	frustum.clip_normals[4] = forward * tan_y - up;
+	for (i = 1; i < 5; i++)
+		frustum.clip_normals[i].normalize();
+	frustum.num_clip_normals = 5;
+}
+
+/// \brief entry of the draw_visible_rooms stack.
+typedef struct {
+	bitu32 room;		///< \brief room being traversed.
+	bitu32 next_edge;	///< \brief next edge of room in room_graph to look through.
+	frustum_t frustum;	///< \brief part of the view that reaches room.
+} room_visit_t;
+
+static std::vector<room_visit_t> room_visits;
+
+static std::vector<bitu32> visible_rooms;	///< \brief rooms drawn this frame.
+
+void draw_room(VT_Level &level, int room_num, const frustum_t &frustum);
+
+/** \brief draws all rooms visible from start.
+  *
+  * Depth first walk through the portals, every portal narrows the frustum. A room can be reached
+  * on several paths with different frustums, so only the rooms on the current path are
+  * skipped. Rooms get drawn once, after their portals have been walked. On levels where the
+  * number of paths explodes the walk stops entering rooms which were already drawn once
+  * MAX_VISITS_PER_ROOM visits per room have been made. The static meshes get tested against
+  * frustum, the drawn rooms end up in visible_rooms.
+  */
+void draw_visible_rooms(VT_Level &level, bitu32 start, const frustum_t &frustum)
+{
+	bitu32 words = (level.rooms.size() + 31) / 32;
+	bitu32 max_visits = level.rooms.size() * MAX_VISITS_PER_ROOM;
+	room_visit_t visit;
+
+	rooms_drawn = 0;
+	rooms_visited = 0;
+	static_meshes_drawn = 0;
+	visible_rooms.clear();
+	if (start >= level.rooms.size())
 		return;
-	room_drawn[room_num] = 1;
+	perf_begin(PERF_PORTALS);
+	room_drawn.resize(0);
+	room_drawn.resize(words, 0);
+	room_on_path.resize(0);
+	room_on_path.resize(words, 0);
+
+	visit.room = start;
+	visit.next_edge = level.room_graph.edge_start[start];
+	visit.frustum = frustum;
+	room_visits.push_back(visit);
+	set_room_bit(room_on_path, start, true);
+	rooms_visited++;
 
-	rooms_drawn++;
-#endif
-	qglPushMatrix();
-	qglTranslatef(room.offset.x, 0, room.offset.z);
-	for (i = 0; i < room.num_rectangles; i++) {
-		tr4_face4_t *face = &room.rectangles[i];
-		tr4_object_texture_t *tex = &level.object_textures[face->texture & 0x0fff];
-		tr4_object_texture_vert_t *tex_vert;
-		tr5_room_vertex_t *vert;
-
-		qglBindTexture(GL_TEXTURE_2D, (tex->tile & 0x0fff) + 1);
-
-		qglBegin(GL_QUADS);
-		//qglBegin(GL_LINE_LOOP);
-		vert = &room.vertices[face->vertices[0]];
-		qglColor3f(vert->colour.r, vert->colour.g, vert->colour.b);
-		tex_vert = &tex->vertices[0];
-		qglTexCoord2f(((float)tex_vert->xpixel + (float)tex_vert->xcoordinate * 0.5f) / 256.0f, ((float)tex_vert->ypixel + (float)tex_vert->ycoordinate * 0.5f) / 256.0f);
-		qglVertex3f(vert->vertex.x, vert->vertex.y, vert->vertex.z);
-		vert = &room.vertices[face->vertices[1]];
-		qglColor3f(vert->colour.r, vert->colour.g, vert->colour.b);
-		tex_vert = &tex->vertices[1];
-		qglTexCoord2f(((float)tex_vert->xpixel + (float)tex_vert->xcoordinate * 0.5f) / 256.0f, ((float)tex_vert->ypixel + (float)tex_vert->ycoordinate * 0.5f) / 256.0f);
-		qglVertex3f(vert->vertex.x, vert->vertex.y, vert->vertex.z);
-		vert = &room.vertices[face->vertices[2]];
-		qglColor3f(vert->colour.r, vert->colour.g, vert->colour.b);
-		tex_vert = &tex->vertices[2];
-		qglTexCoord2f(((float)tex_vert->xpixel + (float)tex_vert->xcoordinate * 0.5f) / 256.0f, ((float)tex_vert->ypixel + (float)tex_vert->ycoordinate * 0.5f) / 256.0f);
-		qglVertex3f(vert->vertex.x, vert->vertex.y, vert->vertex.z);
-		vert = &room.vertices[face->vertices[3]];
-		qglColor3f(vert->colour.r, vert->colour.g, vert->colour.b);
-		tex_vert = &tex->vertices[3];
-		qglTexCoord2f(((float)tex_vert->xpixel + (float)tex_vert->xcoordinate * 0.5f) / 256.0f, ((float)tex_vert->ypixel + (float)tex_vert->ycoordinate * 0.5f) / 256.0f);
-		qglVertex3f(vert->vertex.x, vert->vertex.y, vert->vertex.z);
-		qglEnd();
-	}
-	for (i = 0; i < room.num_triangles; i++) {
-		tr4_face3_t *face = &room.triangles[i];
-		tr4_object_texture_t *tex = &level.object_textures[face->texture & 0x0fff];
-		tr4_object_texture_vert_t *tex_vert;
-		tr5_room_vertex_t *vert;
-
-		qglBindTexture(GL_TEXTURE_2D, (tex->tile & 0x0fff) + 1);
-
-		qglBegin(GL_TRIANGLES);
-		//qglBegin(GL_LINE_LOOP);
-		vert = &room.vertices[face->vertices[0]];
-		qglColor3f(vert->colour.r, vert->colour.g, vert->colour.b);
-		tex_vert = &tex->vertices[0];
-		qglTexCoord2f(((float)tex_vert->xpixel + (float)tex_vert->xcoordinate * 0.5f) / 256.0f, ((float)tex_vert->ypixel + (float)tex_vert->ycoordinate * 0.5f) / 256.0f);
-		qglVertex3f(vert->vertex.x, vert->vertex.y, vert->vertex.z);
-		vert = &room.vertices[face->vertices[1]];
-		qglColor3f(vert->colour.r, vert->colour.g, vert->colour.b);
-		tex_vert = &tex->vertices[1];
-		qglTexCoord2f(((float)tex_vert->xpixel + (float)tex_vert->xcoordinate * 0.5f) / 256.0f, ((float)tex_vert->ypixel + (float)tex_vert->ycoordinate * 0.5f) / 256.0f);
-		qglVertex3f(vert->vertex.x, vert->vertex.y, vert->vertex.z);
-		vert = &room.vertices[face->vertices[2]];
-		qglColor3f(vert->colour.r, vert->colour.g, vert->colour.b);
-		tex_vert = &tex->vertices[2];
-		qglTexCoord2f(((float)tex_vert->xpixel + (float)tex_vert->xcoordinate * 0.5f) / 256.0f, ((float)tex_vert->ypixel + (float)tex_vert->ycoordinate * 0.5f) / 256.0f);
-		qglVertex3f(vert->vertex.x, vert->vertex.y, vert->vertex.z);
-		qglEnd();
+	while (!room_visits.empty()) {
+		room_visit_t &top = room_visits.back();
+		bitu32 end = level.room_graph.edge_start[top.room + 1];
+
+		if (top.next_edge < end) {
+			vt_room_edge_t &edge = level.room_graph.edges[top.next_edge++];
+
+			if (edge.portal == VT_EDGE_ALTERNATE) {
+				top.next_edge = end;	// the portals come first
+				continue;
+			}
+			if (test_room_bit(room_on_path, edge.room))
+				continue;
+			if (((bitu32)rooms_visited >= max_visits) && test_room_bit(room_drawn, edge.room))
+				continue;
+			if (!narrow_frustum(top.frustum, edge, visit.frustum))
+				continue;
+
+			// top is invalid after this
+			visit.room = edge.room;
+			visit.next_edge = level.room_graph.edge_start[edge.room];
+			room_visits.push_back(visit);
+			set_room_bit(room_on_path, edge.room, true);
+			rooms_visited++;
+			continue;
+		}
+
+		bitu32 room = top.room;
+
+		room_visits.pop_back();
+		set_room_bit(room_on_path, room, false);
+		if (test_room_bit(room_drawn, room))
+			continue;
+		set_room_bit(room_drawn, room, true);
+		rooms_drawn++;
+		visible_rooms.push_back(room);
+		perf_begin(PERF_ROOMS);
+		draw_room(level, room, frustum);
+		perf_end();
 	}
-	qglPopMatrix();
-	DBG(for (i = 0; i < room.num_lights; i++) {
+	perf_end();
+}
+
+void draw_room(VT_Level &level, int room_num, const frustum_t &frustum)
+{
+	tr5_room_t &room = level.rooms[room_num];
+	bitu32 i;
+
+	if (residency)
+		residency_use_room(*residency, room_num);
+	scene_push_matrix();
+	scene_translate(room.offset.x, 0, room.offset.z);
+	draw_batched_mesh(level, level.room_batches[room_num], NULL);
+	scene_pop_matrix();
+	DBG(if (!raster) for (i = 0; i < room.num_lights; i++) {
 	    tr5_room_light_t & light = room.lights[i]; qglBindTexture(GL_TEXTURE_2D, 0); qglColor3f(1.0f, 1.0f, 1.0f); draw_marker(light.pos, 32, true);}
 	) ;
 	for (i = 0; i < room.num_static_meshes; i++)
-		draw_room_staticmesh(level, &room.static_meshes[i]);
+		draw_room_staticmesh(level, &room.static_meshes[i], frustum);
 }
 
-void draw_sprite_texture(tr_sprite_texture_t * sprite_texture)
+void draw_sprite_texture(VT_Level &level, bitu32 sprite)
 {
+	tr_sprite_texture_t *sprite_texture = &level.sprite_textures[sprite];
 	float x1, x2, y1, y2;
 	int width, height;
 
-	width = (sprite_texture->width) / 256;
-	height = (sprite_texture->height) / 256;
-	x1 = (float)sprite_texture->x / 256.0f;
-	x2 = x1 + (float)width / 256.0f;
-	y1 = (float)sprite_texture->y / 256.0f;
-	y2 = y1 + (float)height / 256.0f;
-	qglBindTexture(GL_TEXTURE_2D, (sprite_texture->tile & 0x0fff) + 1);
+	if (level.atlas.pages.empty()) {
+		width = (sprite_texture->width) / 256;
+		height = (sprite_texture->height) / 256;
+		x1 = (float)sprite_texture->x / 256.0f;
+		x2 = x1 + (float)width / 256.0f;
+		y1 = (float)sprite_texture->y / 256.0f;
+		y2 = y1 + (float)height / 256.0f;
+		qglBindTexture(GL_TEXTURE_2D, (sprite_texture->tile & 0x0fff) + 1);
+	} else {
+		vt_atlas_sprite_texture_t & tex = level.atlas.sprite_textures[sprite];
+
+		x1 = tex.u1;
+		x2 = tex.u2;
+		y1 = tex.v1;
+		y2 = tex.v2;
+		qglBindTexture(GL_TEXTURE_2D, ATLAS_TEXTURE_BASE + tex.page);
+	}
 	qglColor4f(1.0f, 1.0f, 1.0f, 1.0f);
 	qglBegin(GL_QUADS);
 	qglTexCoord2f(x1, y1);
@@ -409,111 +588,258 @@ void draw_sprite_texture(tr_sprite_texture_t * sprite_texture)
 	qglEnd();
 }
 
-void draw_item(VT_Level &level, tr2_item_t & item, int object_id)
+void draw_item(VT_Level &level, tr2_item_t & item, int object_id, const frustum_t &frustum)
 {
 	tr_moveable_t *moveable;
 	tr_meshtree_t *mesh_tree;
 	int tos = 1;
 
 	moveable = level.find_moveable_id(object_id);
-	/*if (!moveable)
+	if (!moveable)
 		return;
-	if (moveable->mesh_tree_index >= level.mesh_trees.size())
+
+	vt_box_t &box = level.moveable_boxes[moveable - &level.moveables[0]];
+
+	if (!box_in_frustum(frustum, box.min, box.max, item.pos, item.rotation))
+		return;
+	items_drawn++;
+	/*if (moveable->mesh_tree_index >= level.mesh_trees.size())
 		return;
 	if (moveable->frame_index >= level.frames.size())
 		return;
 	if (level.frames[moveable->frame_index].byte_offset < 0)
 		return;*/
 
-	qglPushMatrix();
-	qglTranslatef(item.pos.x, item.pos.y, item.pos.z);
-	qglRotatef(item.rotation, 0.0f, 1.0f, 0.0f);
+	scene_push_matrix();
+	scene_translate(item.pos.x, item.pos.y, item.pos.z);
+	scene_rotate(item.rotation, 0.0f, 1.0f, 0.0f);
 	mesh_tree = &level.mesh_trees[moveable->mesh_tree_index];
 	for (int i = 0; i < moveable->num_meshes; i++) {
-		draw_tr4_mesh(level, &level.meshes[level.mesh_indices[moveable->starting_mesh] + i], item.intensity1);
+		draw_tr4_mesh(level, level.mesh_indices[moveable->starting_mesh + i], item.intensity1);
 		if (mesh_tree[i].flags & 1) {
-			qglPopMatrix();
+			scene_pop_matrix();
 			tos--;
 		}
 		if (mesh_tree[i].flags & 2) {
-			qglPushMatrix();
+			scene_push_matrix();
 			tos++;
 		}
-		qglTranslatef(mesh_tree[i].offset.x, mesh_tree[i].offset.y, mesh_tree[i].offset.z);
+		scene_translate(mesh_tree[i].offset.x, mesh_tree[i].offset.y, mesh_tree[i].offset.z);
 	}
 	while (tos-- > 0)
-		qglPopMatrix();
+		scene_pop_matrix();
 }
 
-void init_textures(VT_Level &level)
+/** \brief sets up the residency manager for the textiles or atlas pages.
+  *
+  * It prepares them on num_threads worker threads, scaled up if upscale is set and with their
+  * mipmaps if mipmaps is set, and uploads them for upload_ms per frame. They get compressed
+  * if compress is set and the driver has S3TC, cache_dir keeps the compressed textures for
+  * the next start. It keeps the resident ones within budget bytes. If preload is set, all of
+  * them are uploaded right away.
+  */
+void init_textures(VT_Level &level, bool preload, bitu32 budget, bool upscale, bool mipmaps, bool compress, const char *cache_dir, double upload_ms, int num_threads)
 {
-	bitu8 *buffer;
-	unsigned int i;
+	GLint max_size = 0;
 
-	buffer = new bitu8[512 * 512 * 4];
+	qglGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+	if (compress && !(DynGL_HasExtension("GL_EXT_texture_compression_s3tc") && qglCompressedTexImage2DARB)) {
+		printf("textures: no S3TC, uploading them uncompressed\n");
+		compress = false;
+	}
+	residency = new residency_t;
+	if (!level.atlas.pages.empty()) {
+		if ((bitu32)max_size >= level.atlas.page_size) {
+			printf("atlas: %u pages of %ux%u\n", level.atlas.pages.size(), level.atlas.page_size, level.atlas.page_size);
+			residency_init(*residency, level, ATLAS_TEXTURE_BASE, budget, (upscale && ((bitu32)max_size >= level.atlas.page_size * 2)) ? 2 : 1, mipmaps, compress, cache_dir, upload_ms, num_threads);
+			if (preload)
+				residency_load_all(*residency);
+			return;
+		}
+		// too large for this OpenGL implementation, fall back to one texture per textile
+		level.atlas.pages.resize(0);
+		level.build_object_texture_uvs();
+		level.build_batches();
+	}
 
-	for (i = 0; i < level.textile32.size(); i++) {
-		qglBindTexture(GL_TEXTURE_2D, i + 1);
-		//Super2xSaI((bitu8 *)&textures[i].pixels, 1024, 4, buffer, 2048, 4, 256, 256, NULL);
-		//qglTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 512, 512, 0, GL_RGBA, GL_UNSIGNED_BYTE, buffer);
-		qglTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 256, 256, 0, GL_RGBA, GL_UNSIGNED_BYTE, level.textile32[i].pixels);
-		qglTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		qglTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		qglTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		qglTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	residency_init(*residency, level, 1, budget, (upscale && (max_size >= 512)) ? 2 : 1, mipmaps, compress, cache_dir, upload_ms, num_threads);
+	if (preload)
+		residency_load_all(*residency);
+}
+
+/** \brief draws the level as seen from pos.
+  *
+  * Updates current_room and the frame statistics. Leaves the modelview matrix set up for
+  * the camera.
+  */
+void draw_scene(VT_Level &level, ang3_t angles, int width, int height)
+{
+	frustum_t frustum;
+	vt_location_t location;
+	vec3_t forward, right, up;
+	bitu32 i;
+
+	AngleVectors(angles, &forward, &right, &up);
+	draw_calls = 0;
+
+	// follow the camera unless PageUp/PageDown picked the room, use the closest room when
+	// the camera is outside of all rooms
+	if (!room_override) {
+		if (level.locate(pos, location))
+			current_room = location.room;
+		else if (!level.rooms.empty())
+			current_room = vt_nearest_room(level.rooms, pos);
 	}
 
-	delete [] buffer;
+	if (raster) {
+		tr2_colour_t clear = { 77, 77, 77, 255 };
+
+		vt_raster_clear(*raster, clear);
+		vt_matrix_infinite_perspective(raster_projection, VIEW_FOVY, VIEW_ASPECT, 64.0f);
+		raster_matrix = 0;
+		vt_matrix_identity(raster_modelview[0]);
+	} else {
+		qglViewport(0, 0, width, height);
+		qglMatrixMode(GL_PROJECTION);
+		qglLoadIdentity();
+		infinitePerspective(VIEW_FOVY, VIEW_ASPECT, 64.0);
+		qglClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		qglMatrixMode(GL_MODELVIEW);
+		qglLoadIdentity();
+	}
+	scene_rotate(-angles.roll, 0.0, 0.0, 1.0);
+	scene_rotate(-angles.pitch, 1.0, 0.0, 0.0);
+	scene_rotate(-angles.yaw, 0.0, 1.0, 0.0);
+	scene_translate(-pos[0], -pos[1], -pos[2]);
+	get_view_frustum(forward, right, up, frustum);
+	// everything else gets reached through the portals
+	draw_visible_rooms(level, current_room, frustum);
+
+	// only the items of the rooms which were drawn
+	perf_begin(PERF_ITEMS);
+	items_drawn = 0;
+	for (i = 0; i < visible_rooms.size(); i++) {
+		bitu32 room = visible_rooms[i];
+		bitu32 j;
+
+		for (j = level.room_item_start[room]; j < level.room_item_start[room + 1]; j++) {
+			tr2_item_t &item = level.items[level.room_items[j]];
+
+			if (item.object_id == 0) {
+				switch (level.game_version) {
+				case TR_III:
+					draw_item(level, item, 315, frustum);
+					break;
+				case TR_IV:
+				case TR_V:
+					draw_item(level, item, 8, frustum);
+					draw_item(level, item, 9, frustum);
+					break;
+				case TR_IV_DEMO:
+					draw_item(level, item, 10, frustum);
+					draw_item(level, item, 11, frustum);
+					break;
+				default:
+					draw_item(level, item, item.object_id, frustum);
+				}
+			} else
+				draw_item(level, item, item.object_id, frustum);
+		}
+	}
+	perf_end();
+
+	if (raster)
+		vt_raster_flush(*raster);
+	if (residency)
+		residency_update(*residency);
 }
 
-bool main_loop(VT_Level &level, SDL_Surface * const screen)
+/// \brief copies the image of the software renderer to the window.
+static void present_raster(SDL_Surface * const screen)
 {
-	static bitu32 room = 0;
-	static bit32 sprite = 0;
-	static ang3_t angles;
-	static int redraw = 1;
+	SDL_Surface *frame;
 
-	bitu32 i;
-	int quit = 0;
-	SDL_Event event;
-	vec3_t forward, right, up;
+#if SDL_BYTEORDER == SDL_LIL_ENDIAN
+	frame = SDL_CreateRGBSurfaceFrom(&raster->colour[0], raster->width, raster->height, 32, raster->width * 4, 0x000000ff, 0x0000ff00, 0x00ff0000, 0);
+#else
+	frame = SDL_CreateRGBSurfaceFrom(&raster->colour[0], raster->width, raster->height, 32, raster->width * 4, 0xff000000, 0x00ff0000, 0x0000ff00, 0);
+#endif
+	if (frame == NULL)
+		return;
+	SDL_BlitSurface(frame, NULL, screen, NULL);
+	SDL_FreeSurface(frame);
+	SDL_UpdateRect(screen, 0, 0, 0, 0);
+}
+
+/// \brief plays the flyby after the current one, stops after the last one.
+static void next_flyby(VT_Level &level)
+{
+	if (++flyby >= (int)flyby_sequences.size()) {
+		flyby = -1;
+		return;
+	}
+	bench_flyby_path(level, flyby_sequences[flyby], flyby_keys);
+	flyby_t = 0.0f;
+}
+
+/** \brief moves the camera as the input of one frame says.
+  *
+  * Sets redraw if the view changed. Returns true if the viewer should quit.
+  */
+static bool apply_input(VT_Level &level, replay_frame_t &input, int &redraw)
+{
+	bool quit = false;
+	vec3_t forward;
 	float scale;
+	bitu32 i;
+
+	for (i = 0; i < input.num_events; i++) {
+		replay_event_t &event = input.events[i];
 
-	while (SDL_PollEvent(&event)) {
 		switch (event.type) {
 		case SDL_QUIT:
-			quit = 1;
+			quit = true;
 			break;
 		case SDL_MOUSEBUTTONDOWN:
 		case SDL_MOUSEBUTTONUP:
+			redraw = 1;
+			break;
 		case SDL_MOUSEMOTION:
 			redraw = 1;
-			angles.pitch += (float)event.motion.yrel / 2.5f;//270.0f * F_PI;
-			if (angles.pitch > 90)
-				angles.pitch = 90;
-			if (angles.pitch < -90)
-				angles.pitch = -90;
-			angles.yaw -= (float)event.motion.xrel / 2.0f;//180.0f * F_PI;
+			view_angles.pitch += (float)event.yrel / 2.5f;//270.0f * F_PI;
+			if (view_angles.pitch > 90)
+				view_angles.pitch = 90;
+			if (view_angles.pitch < -90)
+				view_angles.pitch = -90;
+			view_angles.yaw -= (float)event.xrel / 2.0f;//180.0f * F_PI;
 			break;
 		case SDL_KEYDOWN:
 			redraw = 1;
-			switch (event.key.keysym.sym) {
+			switch (event.key) {
 			case SDLK_PAGEUP:
+				room_override = true;
 				if ((--current_room) < 0)
 					current_room = level.rooms.size() - 1;
 				break;
 			case SDLK_PAGEDOWN:
+				room_override = true;
 				if ((++current_room) >= level.rooms.size())
 					current_room = 0;
 				break;
+			case SDLK_HOME:
+				room_override = false;
+				break;
 			case SDLK_LEFT:
-				angles.roll += 10.0f;
+				view_angles.roll += 10.0f;
 				break;
 			case SDLK_RIGHT:
-				angles.roll -= 10.0f;
+				view_angles.roll -= 10.0f;
+				break;
+			case SDLK_f:
+				next_flyby(level);
 				break;
 			case SDLK_ESCAPE:
-				quit = 1;
+				quit = true;
 				break;
 			default:
 				break;
@@ -524,70 +850,120 @@ bool main_loop(VT_Level &level, SDL_Surface * const screen)
 		}
 	}
 
-	AngleVectors(angles, &forward, &right, &up);
+	AngleVectors(view_angles, &forward, NULL, NULL);
 
-	if (SDL_GetModState() & KMOD_SHIFT)
+	if (input.shift)
 		scale = 192.0f;
 	else
 		scale = 368.0f;
-	if (SDL_GetMouseState(NULL, NULL) & SDL_BUTTON(1)) {
+	if (input.buttons & SDL_BUTTON(1)) {
 		pos += forward * scale;
 		redraw = 1;
 	}
-	if (SDL_GetMouseState(NULL, NULL) & SDL_BUTTON(3)) {
+	if (input.buttons & SDL_BUTTON(3)) {
 		pos -= forward * scale;
 		redraw = 1;
 	}
-	if (redraw) {
-		frustum_t frustum;
 
-		//qglViewport((screen->w / 2), 0, (screen->w / 2), (screen->h / 2));
-		qglViewport(0, 0, screen->w, screen->h);
-		qglMatrixMode(GL_PROJECTION);
-		qglLoadIdentity();
-		infinitePerspective(90.0, 1.3333, 64.0);
-		qglClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		qglMatrixMode(GL_MODELVIEW);
-		qglLoadIdentity();
-		qglRotatef(-angles.roll, 0.0, 0.0, 1.0);
-		qglRotatef(-angles.pitch, 1.0, 0.0, 0.0);
-		qglRotatef(-angles.yaw, 0.0, 1.0, 0.0);
-		qglTranslatef(-pos[0], -pos[1], -pos[2]);
-		for (i = 0; i < 5; i++)
-			frustum.clip_normals[i] = forward;
-
-		for (i = 0; i < level.rooms.size(); i++)
-			draw_room(level, i, frustum);
-
-		memset(room_drawn, 0, level.rooms.size());
-		rooms_drawn = 0;
-		rooms_visited = 0;
-		//draw_room(level, current_room, frustum);
-		room_stack.clear();
-
-		for (i = 0; i < level.items.size(); i++) {
-			if (level.items[i].object_id == 0) {
-				switch (level.game_version) {
-				case TR_III:
-					draw_item(level, level.items[i], 315);
-					break;
-				case TR_IV:
-				case TR_V:
-					draw_item(level, level.items[i], 8);
-					draw_item(level, level.items[i], 9);
-					break;
-				case TR_IV_DEMO:
-					draw_item(level, level.items[i], 10);
-					draw_item(level, level.items[i], 11);
-					break;
-				default:
-					draw_item(level, level.items[i], level.items[i].object_id);
-				}
-			} else
-				draw_item(level, level.items[i], level.items[i].object_id);
+	// a playing flyby moves the camera by a fixed step every frame
+	if (flyby >= 0) {
+		bench_key_t key;
+
+		bench_sample_path(flyby_keys, flyby_t, key);
+		pos = key.pos;
+		view_angles = key.angles;
+		redraw = 1;
+		flyby_t += 1.0f / BENCH_FRAMES_PER_KEY;
+		if (flyby_t > flyby_keys.size() - 1)
+			next_flyby(level);
+	}
+
+	return quit;
+}
+
+/// \brief true if apply_input could change anything, only these frames get recorded.
+static bool input_active(replay_frame_t &input)
+{
+	return (input.num_events > 0) || (input.buttons & (SDL_BUTTON(1) | SDL_BUTTON(3)));
+}
+
+/** \brief waits until a replayed frame is due.
+  *
+  * Keeps the timing of the recording, the first frame is played at once.
+  */
+static void wait_for_frame(replay_frame_t &input)
+{
+	static bool started = false;
+	static bitu32 offset;
+	bitu32 now = SDL_GetTicks();
+
+	if (!started) {
+		offset = now - input.time;
+		started = true;
+	}
+	if ((bit32)(input.time + offset - now) > 0)
+		SDL_Delay(input.time + offset - now);
+}
+
+bool main_loop(VT_Level &level, SDL_Surface * const screen)
+{
+	static bitu32 room = 0;
+	static bit32 sprite = 0;
+	static int redraw = 1;
+
+	replay_frame_t input;
+	bool quit;
+	vec3_t forward, right, up;
+
+	if (replay_in) {
+		SDL_Event event;
+
+		// the window still has to be served, closing it stops the replay
+		while (SDL_PollEvent(&event))
+			if (event.type == SDL_QUIT)
+				return false;
+		if (!replay_read_frame(replay_in, input))
+			return false;
+		wait_for_frame(input);
+	} else {
+		replay_poll_input(input);
+		// -flyby starts like a press of F, so a recording replays it
+		if (start_flyby && (input.num_events < REPLAY_MAX_EVENTS)) {
+			replay_event_t &event = input.events[input.num_events++];
+
+			event.type = SDL_KEYDOWN;
+			event.key = SDLK_f;
+			event.xrel = 0;
+			event.yrel = 0;
+			start_flyby = false;
 		}
+	}
+	if (replay_out && (input_active(input) || (flyby >= 0)))
+		replay_write_frame(replay_out, input);
+	quit = apply_input(level, input, redraw);
+	// keep drawing until the textures in view are uploaded and shown
+	if (residency && residency_pending(*residency))
+		redraw = 1;
+
+	AngleVectors(view_angles, &forward, &right, &up);
 
+	if (redraw && raster) {
+		// no overlay in software mode
+		perf_begin_frame();
+		draw_scene(level, view_angles, screen->w, screen->h);
+		present_raster(screen);
+		perf_end_frame();
 		redraw = 0;
+	}
+	if (redraw) {
+		perf_frame_t avg, worst;
+
+		perf_begin_frame();
+		draw_scene(level, view_angles, screen->w, screen->h);
+
+		redraw = 0;
+		perf_begin(PERF_HUD);
+		perf_get_stats(avg, worst);
 		qglLoadIdentity();
 		qglTranslatef(0, 0, -100);
 		qglScalef(10,10,10);
@@ -610,12 +986,18 @@ bool main_loop(VT_Level &level, SDL_Surface * const screen)
 		qglOrtho(0, 640, 480, 0, -1, 1);
 		qglMatrixMode(GL_MODELVIEW);
 		qglLoadIdentity();
-		draw_string(0, 0, 1.0f, 1.0f, 1.0f, 1.0f, "x: %5.0f, y: %5.0f, z: %5.0f\nyaw: %6.2f, pitch: %6.2f, roll: %6.2f\nrooms_drawn %4i\nrooms_visited %4i", pos[0], pos[1], pos[2], angles[0], angles[1], angles[2], rooms_drawn, rooms_visited);
+		draw_string(0, 0, 1.0f, 1.0f, 1.0f, 1.0f, "x: %5.0f, y: %5.0f, z: %5.0f\nyaw: %6.2f, pitch: %6.2f, roll: %6.2f\nrooms_drawn %4i\nrooms_visited %4i\nroom %4i\nstatic_meshes_drawn %4i\nitems_drawn %4i\ndraw_calls %4i", pos[0], pos[1], pos[2], view_angles[0], view_angles[1], view_angles[2], rooms_drawn, rooms_visited, current_room, static_meshes_drawn, items_drawn, draw_calls);
+		draw_string(0, 144, 1.0f, 1.0f, 0.0f, 1.0f, "        avg ms  p99 ms\nframe   %6.2f  %6.2f\nportals %6.2f  %6.2f\nrooms   %6.2f  %6.2f\nitems   %6.2f  %6.2f\nhud     %6.2f  %6.2f\ngl draws %5u verts %7u binds %5u\nstate changes elided %5u\ntextures %u KB, %u uploads, %u evictions",
+			    avg.frame_ms, worst.frame_ms, avg.stage_ms[PERF_PORTALS], worst.stage_ms[PERF_PORTALS], avg.stage_ms[PERF_ROOMS], worst.stage_ms[PERF_ROOMS],
+			    avg.stage_ms[PERF_ITEMS], worst.stage_ms[PERF_ITEMS], avg.stage_ms[PERF_HUD], worst.stage_ms[PERF_HUD], avg.draw_calls, avg.vertices, avg.texture_binds, avg.state_elided,
+			    residency ? residency->resident_bytes / 1024 : 0, residency ? residency->uploads : 0, residency ? residency->evictions : 0);
+		perf_end();
 /*
 		draw_string(0, 0, 1.0f, 1.0f, 1.0f, 1.0f, "Sprite: %i", sprite);
-		draw_sprite_texture(&level.sprite_textures[sprite]);
+		draw_sprite_texture(level, sprite);
 */
 		SDL_GL_SwapBuffers();
+		perf_end_frame();
 	}
 
 	if (quit)
@@ -624,6 +1006,91 @@ bool main_loop(VT_Level &level, SDL_Surface * const screen)
 		return true;
 }
 
+/// \brief returns the p-th percentile (nearest rank) of sorted values.
+static double percentile(std::vector<double> &sorted, int p)
+{
+	size_t rank = (sorted.size() * p + 99) / 100;
+
+	return sorted[(rank > 0) ? rank - 1 : 0];
+}
+
+/** \brief renders frames along a camera path and prints statistics.
+  *
+  * If replay_in is set, the camera follows the input log instead and keys and frames are
+  * not used.
+  *
+  * Prints one CSV line per frame to stdout. cpu_ms is the time to issue the frame, frame_ms
+  * also includes qglFinish (the same with the software renderer). checksum is a hash of the RGBA pixels, the final checksum combines
+  * all frames, so two runs rendered the same images if it matches. Returns the final checksum.
+  */
+bitu32 run_benchmark(VT_Level &level, bench_key_array_t &keys, int frames, int width, int height, SDL_Surface * const screen)
+{
+	bitu8 *pixels = new bitu8[width * height * 4];
+	bitu32 total = BENCH_CHECKSUM_INIT;
+	double cpu_sum = 0.0, frame_sum = 0.0;
+	std::vector<double> frame_times;
+	int frame;
+
+	printf("frame,cpu_ms,frame_ms,draw_calls,rooms_drawn,rooms_visited,checksum\n");
+	for (frame = 0; replay_in || (frame < frames); frame++) {
+		bench_key_t key;
+		double start, issued, finished;
+		bitu32 checksum, le_checksum;
+
+		if (replay_in) {
+			replay_frame_t input;
+			int redraw;
+
+			// one frame of the log per frame, without waiting
+			if (!replay_read_frame(replay_in, input) || apply_input(level, input, redraw))
+				break;
+			key.angles = view_angles;
+		} else {
+			if (frames > 1)
+				bench_sample_path(keys, (float)frame * (keys.size() - 1) / (frames - 1), key);
+			else
+				bench_sample_path(keys, 0.0f, key);
+			pos = key.pos;
+		}
+
+		perf_begin_frame();
+		start = bench_time();
+		draw_scene(level, key.angles, width, height);
+		issued = bench_time();
+		if (!raster)
+			qglFinish();
+		finished = bench_time();
+		perf_end_frame();
+
+		if (raster)
+			checksum = bench_checksum(BENCH_CHECKSUM_INIT, (bitu8 *)&raster->colour[0], width * height * 4);
+		else {
+			qglReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+			checksum = bench_checksum(BENCH_CHECKSUM_INIT, pixels, width * height * 4);
+		}
+		le_checksum = SDL_SwapLE32(checksum);
+		total = bench_checksum(total, (bitu8 *)&le_checksum, 4);
+		if (screen && raster)
+			present_raster(screen);
+		else if (screen)
+			SDL_GL_SwapBuffers();
+
+		printf("%i,%.3f,%.3f,%i,%i,%i,%08x\n", frame, issued - start, finished - start, draw_calls, rooms_drawn, rooms_visited, checksum);
+		cpu_sum += issued - start;
+		frame_sum += finished - start;
+		frame_times.push_back(finished - start);
+	}
+	if (frame > 0) {
+		std::sort(frame_times.begin(), frame_times.end());
+		printf("# %i frames, cpu_ms avg %.3f, frame_ms avg %.3f min %.3f p50 %.3f p95 %.3f p99 %.3f max %.3f, checksum %08x\n", frame, cpu_sum / frame, frame_sum / frame,
+		       frame_times.front(), percentile(frame_times, 50), percentile(frame_times, 95), percentile(frame_times, 99), frame_times.back(), total);
+	}
+
+	delete [] pixels;
+
+	return total;
+}
+
 #if (defined(_DEBUG) && defined(_MSC_VER))
 static int normal_count = 0;
 static int free_count = 0;
@@ -658,7 +1125,26 @@ int _tmain(int argc, _TCHAR* argv[])
 {
 	VT_Level *level = NULL;
 	int game_num, level_num;
-	SDL_Surface *screen;
+	SDL_Surface *screen = NULL;
+	bench_key_array_t bench_keys;
+	bool benchmark = false;
+	bool bench_window = false;
+	const _TCHAR *bench_path = NULL;
+	int bench_frames = 0;
+	const _TCHAR *record_path = NULL;
+	const _TCHAR *perf_path = NULL;
+	const _TCHAR *replay_path = NULL;
+	bool flyby_mode = false;
+	bool state_cache = true;
+	bool preload = false;
+	int texture_budget = 0;
+	int upload_ms = 2;
+	bool upscale = false;
+	bool mipmaps = true;
+	bool compress = true;
+	const _TCHAR *cache_dir = NULL;
+	bool software = false;
+	int num_threads = vt_raster_cpu_count();
 
 #if 0
 #if (defined(_DEBUG) && defined(_MSC_VER))
@@ -719,11 +1205,57 @@ int _tmain(int argc, _TCHAR* argv[])
 
 	//chdir(gamepath_info[game_num].path);
 	try {
+		int i;
+
 		level = new VT_Level;
 
+		for (i = 1; i < argc; i++)
+			if (_tcscmp(argv[i], _T("-compact")) == 0)
+				level->compact_geometry = true;
+			else if (_tcscmp(argv[i], _T("-atlas")) == 0)
+				level->atlas_page_size = 2048;
+			else if (_tcscmp(argv[i], _T("-benchmark")) == 0) {
+				benchmark = true;
+				// optional path file, the default path visits all rooms
+				if ((i + 1 < argc) && (argv[i + 1][0] != '-'))
+					bench_path = argv[++i];
+			} else if ((_tcscmp(argv[i], _T("-frames")) == 0) && (i + 1 < argc))
+				bench_frames = _ttoi(argv[++i]);
+			else if (_tcscmp(argv[i], _T("-window")) == 0)
+				bench_window = true;
+			else if ((_tcscmp(argv[i], _T("-record")) == 0) && (i + 1 < argc))
+				record_path = argv[++i];
+			else if ((_tcscmp(argv[i], _T("-replay")) == 0) && (i + 1 < argc))
+				replay_path = argv[++i];
+			else if (_tcscmp(argv[i], _T("-flyby")) == 0)
+				flyby_mode = true;
+			else if ((_tcscmp(argv[i], _T("-perf")) == 0) && (i + 1 < argc))
+				perf_path = argv[++i];
+			else if (_tcscmp(argv[i], _T("-nocache")) == 0)
+				state_cache = false;
+			else if (_tcscmp(argv[i], _T("-preload")) == 0)
+				preload = true;
+			else if ((_tcscmp(argv[i], _T("-texmem")) == 0) && (i + 1 < argc))
+				texture_budget = _ttoi(argv[++i]);
+			else if ((_tcscmp(argv[i], _T("-uploadms")) == 0) && (i + 1 < argc))
+				upload_ms = _ttoi(argv[++i]);
+			else if (_tcscmp(argv[i], _T("-upscale")) == 0)
+				upscale = true;
+			else if (_tcscmp(argv[i], _T("-nomipmaps")) == 0)
+				mipmaps = false;
+			else if (_tcscmp(argv[i], _T("-nocompress")) == 0)
+				compress = false;
+			else if ((_tcscmp(argv[i], _T("-texcache")) == 0) && (i + 1 < argc))
+				cache_dir = argv[++i];
+			else if (_tcscmp(argv[i], _T("-software")) == 0)
+				software = true;
+			else if ((_tcscmp(argv[i], _T("-threads")) == 0) && (i + 1 < argc))
+				num_threads = _ttoi(argv[++i]);
+
 		level->read_level(SDL_RWFromFile("DATA/TUT1.TR4", "rb"), gamepath_info[game_num].version);
 		//level->read_level(SDL_RWFromFile(gamepath_info[game_num].levels[level_num].filename, "rb"), gamepath_info[game_num].version);
 		level->prepare_level();
+		bench_flyby_sequences(*level, flyby_sequences);
 	}
 	catch(TR_ReadError *except) {
 		printf("Error: %s in %s:%i\n%s\n", except->m_message, except->m_file, except->m_line, except->m_rcsid);
@@ -733,64 +1265,162 @@ int _tmain(int argc, _TCHAR* argv[])
 		return 1;
 	}
 
-	room_drawn = new bitu8[level->rooms.size()];
-
 	//DBG(dump_textures(*level););
 
-	if (SDL_Init(SDL_INIT_VIDEO) < 0)
-		return 1;
-
-	if (DynGL_LoadLibrary("OPENGL32.DLL") == SDL_FALSE) {
-		fprintf(stderr, "DynGL_LoadLibrary failed: %s\n", SDL_GetError());
-		return 1;
+	if (benchmark && !replay_path && !flyby_mode) {
+		if (bench_path) {
+			if (!bench_load_path(bench_path, bench_keys)) {
+				fprintf(stderr, "Can't read camera path %s\n", bench_path);
+				return 1;
+			}
+		} else
+			bench_room_path(*level, bench_keys);
+		if (bench_keys.empty()) {
+			fprintf(stderr, "Empty camera path\n");
+			return 1;
+		}
+		if (bench_frames <= 0)
+			bench_frames = BENCH_FRAMES_PER_KEY * (bench_keys.size() > 1 ? bench_keys.size() - 1 : 1);
 	}
 
-	SDL_GL_SetAttribute(SDL_GL_RED_SIZE, 0);
-	SDL_GL_SetAttribute(SDL_GL_GREEN_SIZE, 0);
-	SDL_GL_SetAttribute(SDL_GL_BLUE_SIZE, 0);
-	SDL_GL_SetAttribute(SDL_GL_DEPTH_SIZE, 0);
-	SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
+	if (software) {
+		// draw with vt_raster instead of OpenGL
+		raster = new vt_raster_t;
+		vt_raster_init(*raster, VIEW_WIDTH, VIEW_HEIGHT, num_threads);
+		printf("software renderer: %i threads\n", raster->num_threads);
+		if (!benchmark || bench_window) {
+			if (SDL_Init(SDL_INIT_VIDEO) < 0)
+				return 1;
+			if ((screen = SDL_SetVideoMode(VIEW_WIDTH, VIEW_HEIGHT, 32, SDL_SWSURFACE)) == NULL)
+				return 1;
+		}
+	} else if (benchmark && !bench_window) {
+		// headless, render into memory
+		if (!bench_create_offscreen(VIEW_WIDTH, VIEW_HEIGHT)) {
+			fprintf(stderr, "bench_create_offscreen failed: %s\n", SDL_GetError());
+			return 1;
+		}
+	} else {
+		if (SDL_Init(SDL_INIT_VIDEO) < 0)
+			return 1;
 
-	if ((screen = SDL_SetVideoMode(640, 480, 0, SDL_OPENGL)) == NULL)
-		return 1;
+		if (DynGL_LoadLibrary("OPENGL32.DLL") == SDL_FALSE) {
+			fprintf(stderr, "DynGL_LoadLibrary failed: %s\n", SDL_GetError());
+			return 1;
+		}
 
-	if (DynGL_GetFunctions(NULL) == SDL_FALSE) {
+		SDL_GL_SetAttribute(SDL_GL_RED_SIZE, 0);
+		SDL_GL_SetAttribute(SDL_GL_GREEN_SIZE, 0);
+		SDL_GL_SetAttribute(SDL_GL_BLUE_SIZE, 0);
+		SDL_GL_SetAttribute(SDL_GL_DEPTH_SIZE, 0);
+		SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
+
+		if ((screen = SDL_SetVideoMode(VIEW_WIDTH, VIEW_HEIGHT, 0, SDL_OPENGL)) == NULL)
+			return 1;
+	}
+
+	if (!raster && (DynGL_GetFunctions(NULL) == SDL_FALSE)) {
 		fprintf(stderr, "DynGL_GetFunctions failed: %s\n", SDL_GetError());
 		return 1;
 	}
+	// the GL counters cost a little, plain benchmarks go without
+	if (!raster && (!benchmark || perf_path))
+		DynGL_SetCounting(SDL_TRUE);
+	// on top of the counting, so only the calls which reach the driver get counted
+	if (!raster && state_cache)
+		DynGL_SetStateCache(SDL_TRUE);
+	if (perf_path && !perf_open_csv(perf_path)) {
+		fprintf(stderr, "Can't create %s\n", perf_path);
+		return 1;
+	}
 
-	SDL_ShowCursor(0);
-	SDL_WM_GrabInput(SDL_GRAB_ON);
-	SDL_EnableKeyRepeat(SDL_DEFAULT_REPEAT_DELAY, SDL_DEFAULT_REPEAT_INTERVAL);
-
-	qglEnable(GL_DEPTH_TEST);
-	qglDepthFunc(GL_LESS);
-	qglClearColor(0.3f, 0.3f, 0.3f, 1.0f);
-	qglEnable(GL_TEXTURE_2D);
-	qglEnable(GL_CULL_FACE);
-	qglCullFace(GL_FRONT);
-	qglEnable(GL_BLEND);
-	qglBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	qglColor4f(1.0f, 1.0f, 1.0f, 1.0f);
-	qglEnable(GL_ALPHA_TEST);
-	qglAlphaFunc(GL_GEQUAL, 0.5f);
+	if (!benchmark) {
+		SDL_ShowCursor(0);
+		SDL_WM_GrabInput(SDL_GRAB_ON);
+		SDL_EnableKeyRepeat(SDL_DEFAULT_REPEAT_DELAY, SDL_DEFAULT_REPEAT_INTERVAL);
+	}
 
-	//init_font("c:/home/dev/cvs/vt2/data/font.bmp", 64);
-	init_font("font.bmp", 64);
-	init_textures(*level);
+	if (!raster) {
+		qglEnable(GL_DEPTH_TEST);
+		qglDepthFunc(GL_LESS);
+		qglClearColor(0.3f, 0.3f, 0.3f, 1.0f);
+		qglEnable(GL_TEXTURE_2D);
+		qglEnable(GL_CULL_FACE);
+		qglCullFace(GL_FRONT);
+		qglEnable(GL_BLEND);
+		qglBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		qglColor4f(1.0f, 1.0f, 1.0f, 1.0f);
+		qglEnable(GL_ALPHA_TEST);
+		qglAlphaFunc(GL_GEQUAL, 0.5f);
+
+		//init_font("c:/home/dev/cvs/vt2/data/font.bmp", 64);
+		init_font("font.bmp", 64);
+		// -texmem is in MB; benchmarks start with every texture resident, so their checksums
+		// don't depend on the worker timing and -uploadms
+		init_textures(*level, preload || benchmark, (texture_budget > 0) ? texture_budget * 1024 * 1024 : 0, upscale, mipmaps, compress, cache_dir, upload_ms, num_threads - 1);
+	}
+	// the batches are final now, the renderers don't need the room streams any more
+	level->free_room_streams();
 
 	if ((lara = level->find_item_id(0)) != NULL) {
 		pos[0] = lara->pos.x;
 		pos[1] = lara->pos.y + 490.0f;
 		pos[2] = lara->pos.z;
-		current_room = lara->room;
 	}
 
-	while (main_loop(*level, screen)) ;
+	if (replay_path) {
+		// the log starts with its own camera
+		if ((replay_in = replay_open(replay_path, pos, view_angles)) == NULL) {
+			fprintf(stderr, "Can't read input log %s\n", replay_path);
+			return 1;
+		}
+	} else if (record_path) {
+		if ((replay_out = replay_create(record_path, pos, view_angles)) == NULL) {
+			fprintf(stderr, "Can't create input log %s\n", record_path);
+			return 1;
+		}
+	}
 
+	if (benchmark)
+		printf("# dedup meshes %u -> %u, textiles %u -> %u, %u KB saved\n", level->dedup_report.meshes_before, level->dedup_report.meshes_after,
+		       level->dedup_report.textiles_before, level->dedup_report.textiles_after, level->dedup_report.bytes_saved / 1024);
+
+	if (benchmark && flyby_mode && !replay_in) {
+		bitu32 j;
+
+		// every flyby is a benchmark of its own
+		for (j = 0; j < flyby_sequences.size(); j++) {
+			bench_flyby_path(*level, flyby_sequences[j], bench_keys);
+			printf("# flyby %u, %u cameras\n", flyby_sequences[j], bench_keys.size());
+			run_benchmark(*level, bench_keys, (bench_frames > 0) ? bench_frames : BENCH_FRAMES_PER_KEY * (bench_keys.size() > 1 ? bench_keys.size() - 1 : 1), VIEW_WIDTH, VIEW_HEIGHT, screen);
+		}
+	} else if (benchmark)
+		run_benchmark(*level, bench_keys, bench_frames, VIEW_WIDTH, VIEW_HEIGHT, screen);
+	else {
+		start_flyby = flyby_mode && !replay_in;
+		while (main_loop(*level, screen)) ;
+	}
+
+	// the residency workers and the software renderer read the level until they are stopped
+	if (raster) {
+		vt_raster_free(*raster);
+		delete raster;
+	} else {
+		if (residency) {
+			residency_free(*residency);
+			delete residency;
+		}
+		DynGL_CloseLibrary();
+		if (!screen)
+			bench_destroy_offscreen();
+	}
 	delete level;
 
-	DynGL_CloseLibrary();
+	perf_close_csv();
+	if (replay_in)
+		SDL_RWclose(replay_in);
+	if (replay_out)
+		SDL_RWclose(replay_out);
 	SDL_Quit();
 
 	return 0;
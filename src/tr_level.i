@@ -115,4 +115,60 @@ namespace prtl {
     }
 }
 
+// loader internal
+%ignore tr_mesh_staging_t;
+
 %include "l_main.h"
+
+// per mesh access to the level wide mesh pools, i counts from the first element of the mesh
+%{
+static bitu32 mesh_pool_index(int i, int count, bitu32 offset)
+{
+	if (i < 0)
+		i += count;
+	if ((i < 0) || (i >= count))
+		throw prtl::prtl_exception("mesh element out of bounds");
+	return offset + i;
+}
+%}
+
+%exception {
+    try {
+        $action
+    } catch (prtl::prtl_exception &e) {
+        SWIG_exception(SWIG_IndexError,const_cast<char*>(e.m_message));
+    }
+}
+
+%extend TR_Level {
+	tr5_vertex_t& get_mesh_vertex(int mesh, int i) {
+		tr4_mesh_t &m = self->meshes[mesh];
+		return self->mesh_vertices[mesh_pool_index(i, m.num_vertices, m.vertex_offset)];
+	}
+	tr5_vertex_t& get_mesh_normal(int mesh, int i) {
+		tr4_mesh_t &m = self->meshes[mesh];
+		return self->mesh_normals[mesh_pool_index(i, m.num_normals, m.normal_offset)];
+	}
+	bit16 get_mesh_light(int mesh, int i) {
+		tr4_mesh_t &m = self->meshes[mesh];
+		return self->mesh_lights[mesh_pool_index(i, m.num_lights, m.light_offset)];
+	}
+	tr4_face4_t& get_mesh_textured_rectangle(int mesh, int i) {
+		tr4_mesh_t &m = self->meshes[mesh];
+		return self->mesh_rectangles[mesh_pool_index(i, m.num_textured_rectangles, m.textured_rectangle_offset)];
+	}
+	tr4_face4_t& get_mesh_coloured_rectangle(int mesh, int i) {
+		tr4_mesh_t &m = self->meshes[mesh];
+		return self->mesh_rectangles[mesh_pool_index(i, m.num_coloured_rectangles, m.coloured_rectangle_offset)];
+	}
+	tr4_face3_t& get_mesh_textured_triangle(int mesh, int i) {
+		tr4_mesh_t &m = self->meshes[mesh];
+		return self->mesh_triangles[mesh_pool_index(i, m.num_textured_triangles, m.textured_triangle_offset)];
+	}
+	tr4_face3_t& get_mesh_coloured_triangle(int mesh, int i) {
+		tr4_mesh_t &m = self->meshes[mesh];
+		return self->mesh_triangles[mesh_pool_index(i, m.num_coloured_triangles, m.coloured_triangle_offset)];
+	}
+}
+
+%exception;
@@ -280,26 +280,32 @@ typedef struct {
 typedef prtl::array < tr5_room_t > tr5_room_array_t;
 
 /** \brief Mesh.
+  *
+  * The vertices, normals, lights and faces of all meshes are stored in the flattened pools of
+  * TR_Level (mesh_vertices, mesh_normals, mesh_lights, mesh_rectangles and mesh_triangles).
+  * A mesh only holds the offset of its first element and the count for each list.
+  * The coloured rectangles of a mesh directly follow its textured rectangles in the pool, the same
+  * is true for the triangles.
   */
 typedef struct {
 	tr5_vertex_t centre;	// This is usually close to the mesh's centroid, and appears to be the center of a sphere used for collision testing.
 	bit32 collision_size;	// This appears to be the radius of that aforementioned collisional sphere.
 	bit16 num_vertices;	// number of vertices in this mesh
-	tr5_vertex_array_t vertices;	//[NumVertices]; // list of vertices (relative coordinates)
+	bitu32 vertex_offset;	// offset into mesh_vertices (relative coordinates)
 	bit16 num_normals;	// If positive, number of normals in this mesh.
 	// If negative, number of vertex lighting elements (* (-1))
 	bit16 num_lights;	// Engine internal for above
-	tr5_vertex_array_t normals;	//[NumNormals]; // list of normals (if NumNormals is positive)
-	bit16_array_t lights;	//[-NumNormals]; // list of light values (if NumNormals is negative)
+	bitu32 normal_offset;	// offset into mesh_normals (if NumNormals is positive)
+	bitu32 light_offset;	// offset into mesh_lights (if NumNormals is negative)
 	bit16 num_textured_rectangles;	// number of textured rectangles in this mesh
-	tr4_face4_array_t textured_rectangles;	//[NumTexturedRectangles]; // list of textured rectangles
+	bitu32 textured_rectangle_offset;	// offset into mesh_rectangles
 	bit16 num_textured_triangles;	// number of textured triangles in this mesh
-	tr4_face3_array_t textured_triangles;	//[NumTexturedTriangles]; // list of textured triangles
+	bitu32 textured_triangle_offset;	// offset into mesh_triangles
 	// the rest is not present in TR4
 	bit16 num_coloured_rectangles;	// number of coloured rectangles in this mesh
-	tr4_face4_array_t coloured_rectangles;	//[NumColouredRectangles]; // list of coloured rectangles
+	bitu32 coloured_rectangle_offset;	// offset into mesh_rectangles
 	bit16 num_coloured_triangles;	// number of coloured triangles in this mesh
-	tr4_face3_array_t coloured_triangles;	//[NumColouredTriangles]; // list of coloured triangles
+	bitu32 coloured_triangle_offset;	// offset into mesh_triangles
 } tr4_mesh_t;
 typedef prtl::array < tr4_mesh_t > tr4_mesh_array_t;
 
@@ -603,18 +609,22 @@ typedef struct {
 } tr_camera_t;
 typedef prtl::array < tr_camera_t > tr_camera_array_t;
 
-/** \brief Extra Camera.
-  */
-typedef struct {
-	bit32 x1;
-	bit32 y1;
-	bit32 z1;
-	bit32 x2;
-	bit32 y2;
-	bitu8 index1;
-	bitu8 index2;
-	bitu16 unknown[5];
-	bit32 id;
+/** \brief Flyby camera.
+  *
+  * Key of one of the camera tours of a TR4 / TR5 level. The keys of a tour share sequence
+  * and are ordered by index.
+  */
+typedef struct {		// 40 bytes
+	tr5_vertex_t pos;	// camera position (world coords)
+	tr5_vertex_t target;	// point the camera looks at (world coords)
+	bitu8 sequence;		// tour the key belongs to
+	bitu8 index;		// position of the key in the tour
+	bitu16 fov;		// field of view
+	bit16 roll;		// roll (16384 = 90 degrees)
+	bitu16 timer;		// time the camera stays at the key
+	bitu16 speed;		// speed towards the next key
+	bitu16 flags;
+	bitu32 room;		// room which contains pos
 } tr4_flyby_camera_t;
 typedef prtl::array < tr4_flyby_camera_t > tr4_flyby_camera_array_t;
 
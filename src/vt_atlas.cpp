@@ -0,0 +1,105 @@
+/*
+ * Copyright 2002 - Florian Schulze <crow@icculus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * This file is part of vt.
+ *
+ */
+
+#include <stdlib.h>
+#include "vt_atlas.h"
+
+#define RCSID "$Id$"
+
+/// \brief copies a textile with its padding into an atlas page.
+static void blit_tile(tr4_textile32_t & src, bitu32 *dst, bitu32 page_size, bitu32 x0, bitu32 y0, bitu32 padding)
+{
+	int x, y;
+	int pad = padding;
+
+	for (y = -pad; y < 256 + pad; y++) {
+		int sy = (y < 0) ? 0 : ((y > 255) ? 255 : y);
+		bitu32 *row = dst + (y0 + y) * page_size + x0;
+
+		for (x = -pad; x < 256 + pad; x++) {
+			int sx = (x < 0) ? 0 : ((x > 255) ? 255 : x);
+
+			row[x] = src.pixels[sy][sx];
+		}
+	}
+}
+
+/** \brief packs all textiles into atlas pages and converts the texture coordinates.
+  *
+  * The pages are the smallest power of two up to max_page_size, which holds all textiles or as
+  * many as fit. Sprite textures get their coordinates in atlas space, already scaled to 0-1.
+  * Returns false and leaves atlas empty if not even a single
+  * padded textile fits into max_page_size.
+  */
+bool vt_build_atlas(tr4_textile32_array_t & textiles, tr_sprite_texture_array_t & sprite_textures, bitu32 max_page_size, bitu32 padding, vt_atlas_t & atlas)
+{
+	bitu32 cell = 256 + 2 * padding;
+	bitu32 per_page, per_row;
+	bitu32 num_tiles = textiles.size();
+	bitu32 i;
+
+	if ((num_tiles == 0) || (max_page_size < cell))
+		return false;
+
+	per_row = max_page_size / cell;
+	per_page = per_row * per_row;
+	if (per_page > num_tiles)
+		per_page = num_tiles;
+
+	atlas.page_size = 1;
+	while (((atlas.page_size / cell) * (atlas.page_size / cell) < per_page) && (atlas.page_size * 2 <= max_page_size))
+		atlas.page_size *= 2;
+	if (atlas.page_size < cell)
+		return false;
+	atlas.padding = padding;
+	per_row = atlas.page_size / cell;
+	per_page = per_row * per_row;
+
+	atlas.pages.resize((num_tiles + per_page - 1) / per_page);
+	for (i = 0; i < atlas.pages.size(); i++)
+		atlas.pages[i].resize(atlas.page_size * atlas.page_size, 0);
+
+	atlas.tiles.resize(num_tiles);
+	for (i = 0; i < num_tiles; i++) {
+		vt_atlas_tile_t & tile = atlas.tiles[i];
+		bitu32 slot = i % per_page;
+
+		tile.page = i / per_page;
+		tile.x = (slot % per_row) * cell + padding;
+		tile.y = (slot / per_row) * cell + padding;
+		blit_tile(textiles[i], &atlas.pages[tile.page][0], atlas.page_size, tile.x, tile.y, padding);
+	}
+
+	atlas.sprite_textures.resize(sprite_textures.size());
+	for (i = 0; i < sprite_textures.size(); i++) {
+		tr_sprite_texture_t & src = sprite_textures[i];
+		vt_atlas_sprite_texture_t & dst = atlas.sprite_textures[i];
+		vt_atlas_tile_t & tile = atlas.tiles[((bitu32)src.tile < num_tiles) ? src.tile : 0];
+
+		dst.page = tile.page;
+		dst.u1 = (float)(tile.x + src.x) / (float)atlas.page_size;
+		dst.v1 = (float)(tile.y + src.y) / (float)atlas.page_size;
+		dst.u2 = dst.u1 + (float)(src.width / 256) / (float)atlas.page_size;
+		dst.v2 = dst.v1 + (float)(src.height / 256) / (float)atlas.page_size;
+	}
+
+	return true;
+}
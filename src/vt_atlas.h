@@ -0,0 +1,42 @@
+#ifndef _VT_ATLAS_H_
+#define _VT_ATLAS_H_
+
+#include "tr_types.h"
+
+/// \brief Position of a textile inside the atlas.
+typedef struct {
+	bitu16 page;		///< \brief atlas page.
+	bitu16 x;		///< \brief left edge of the textile (inside the padding).
+	bitu16 y;		///< \brief top edge of the textile (inside the padding).
+} vt_atlas_tile_t;
+typedef prtl::array < vt_atlas_tile_t > vt_atlas_tile_array_t;
+
+/// \brief Sprite texture in atlas space.
+typedef struct {
+	bitu16 page;		///< \brief atlas page.
+	float u1, v1;		///< \brief upper left corner.
+	float u2, v2;		///< \brief lower right corner.
+} vt_atlas_sprite_texture_t;
+typedef prtl::array < vt_atlas_sprite_texture_t > vt_atlas_sprite_texture_array_t;
+
+typedef prtl::array < bitu32_array_t > vt_atlas_page_array_t;
+
+/** \brief Texture atlas.
+  *
+  * All textile32 pages packed into a few square pages of page_size * page_size pixels (same pixel
+  * format as textile32). Every textile is surrounded by padding pixels which repeat its border,
+  * so linear filtering does not pick up texels of the neighbouring textile.
+  * Object textures are converted by VT_Level::prepare_level (see vt_object_texture_uv_t).
+  * pages is empty if no atlas was built.
+  */
+typedef struct {
+	bitu32 page_size;	///< \brief width and height of every page.
+	bitu32 padding;		///< \brief border around every textile.
+	vt_atlas_page_array_t pages;	///< \brief pixels of every page.
+	vt_atlas_tile_array_t tiles;	///< \brief position of every textile, same index as textile32.
+	vt_atlas_sprite_texture_array_t sprite_textures;	///< \brief same index as sprite_textures.
+} vt_atlas_t;
+
+bool vt_build_atlas(tr4_textile32_array_t & textiles, tr_sprite_texture_array_t & sprite_textures, bitu32 max_page_size, bitu32 padding, vt_atlas_t & atlas);
+
+#endif // _VT_ATLAS_H_
@@ -0,0 +1,574 @@
+/*
+ * Copyright 2002 - Florian Schulze <crow@icculus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * This file is part of vt.
+ *
+ */
+
+#include <stdlib.h>
+#include <math.h>
+#include <float.h>
+#include <algorithm>
+#include <vector>
+#include "vt_bvh.h"
+#include "vt_simd.h"
+#ifdef VT_SSE2
+#include <emmintrin.h>
+#endif
+
+#define RCSID "$Id$"
+
+#define BVH_BINS 16		///< \brief number of SAH bins per axis.
+#define BVH_MIN_LEAF 2		///< \brief nodes with this many triangles or less are never split.
+#define BVH_MAX_LEAF 16		///< \brief nodes with more triangles are always split.
+#define BVH_MAX_DEPTH 64	///< \brief from here on nodes get split in the middle, keeps the depth below BVH_STACK_SIZE.
+#define BVH_STACK_SIZE 128	///< \brief traversal stack size.
+#define BVH_INV_LARGE 1e30f	///< \brief inverse of a zero direction component.
+
+/// \brief axis aligned box used during the build.
+typedef struct {
+	float min[3];
+	float max[3];
+} bvh_box_t;
+
+/// \brief data shared by all nodes of a build.
+typedef struct {
+	std::vector < bvh_box_t > bounds;	///< \brief bounds of each triangle.
+	std::vector < float >centroids;	///< \brief 3 floats per triangle.
+	std::vector < bitu32 > order;	///< \brief triangle indices, get partitioned per node.
+	std::vector < vt_bvh_node_t > nodes;
+} bvh_build_t;
+
+static void box_clear(bvh_box_t & box)
+{
+	box.min[0] = box.min[1] = box.min[2] = FLT_MAX;
+	box.max[0] = box.max[1] = box.max[2] = -FLT_MAX;
+}
+
+static void box_grow(bvh_box_t & box, const bvh_box_t & other)
+{
+	int k;
+
+	for (k = 0; k < 3; k++) {
+		if (other.min[k] < box.min[k])
+			box.min[k] = other.min[k];
+		if (other.max[k] > box.max[k])
+			box.max[k] = other.max[k];
+	}
+}
+
+/// \brief half the surface area of a box, 0 for empty boxes.
+static float box_area(const bvh_box_t & box)
+{
+	float dx = box.max[0] - box.min[0];
+	float dy = box.max[1] - box.min[1];
+	float dz = box.max[2] - box.min[2];
+
+	if ((dx < 0.0f) || (dy < 0.0f) || (dz < 0.0f))
+		return 0.0f;
+	return dx * dy + dy * dz + dz * dx;
+}
+
+static void triangle_bounds(const vt_bvh_triangle_t & tri, bvh_box_t & box)
+{
+	int k;
+
+	for (k = 0; k < 3; k++) {
+		float a = tri.v0[k];
+		float b = a + tri.e1[k];
+		float c = a + tri.e2[k];
+
+		box.min[k] = std::min(a, std::min(b, c));
+		box.max[k] = std::max(a, std::max(b, c));
+	}
+}
+
+/// \brief maps a centroid to its SAH bin.
+static int get_bin(float c, float min, float scale)
+{
+	int bin = (int)((c - min) * scale);
+
+	if (bin < 0)
+		return 0;
+	if (bin >= BVH_BINS)
+		return BVH_BINS - 1;
+	return bin;
+}
+
+/// \brief partition predicate, true for triangles left of the split.
+struct bvh_left_of_split {
+	const float *centroids;
+	int axis;
+	float min;
+	float scale;
+	int split;
+
+	bool operator() (bitu32 tri) const {
+		return get_bin(centroids[tri * 3 + axis], min, scale) < split;
+	}
+};
+
+/** \brief builds the subtree of one node.
+  *
+  * Splits with the binned surface area heuristic: the centroids get sorted into BVH_BINS bins
+  * along each axis and the bin boundary with the lowest estimated cost wins. Nodes are only
+  * turned into leaves if that is cheaper than splitting, or if they are small enough.
+  */
+static void build_node(bvh_build_t & build, bitu32 node, bitu32 first, bitu32 count, bitu32 depth)
+{
+	bvh_box_t bounds, centroid_bounds;
+	bitu32 i;
+	int k;
+
+	box_clear(bounds);
+	box_clear(centroid_bounds);
+	for (i = first; i < first + count; i++) {
+		bitu32 tri = build.order[i];
+		bvh_box_t c;
+
+		box_grow(bounds, build.bounds[tri]);
+		for (k = 0; k < 3; k++)
+			c.min[k] = c.max[k] = build.centroids[tri * 3 + k];
+		box_grow(centroid_bounds, c);
+	}
+	for (k = 0; k < 3; k++) {
+		build.nodes[node].min[k] = bounds.min[k];
+		build.nodes[node].max[k] = bounds.max[k];
+	}
+	build.nodes[node].first = first;
+	build.nodes[node].count = count;
+	if (count <= BVH_MIN_LEAF)
+		return;
+
+	float best_cost = FLT_MAX;
+	int best_axis = -1;
+	int best_split = 0;
+
+	if (depth < BVH_MAX_DEPTH) {
+		for (k = 0; k < 3; k++) {
+			float extent = centroid_bounds.max[k] - centroid_bounds.min[k];
+			bvh_box_t bin_bounds[BVH_BINS];
+			bitu32 bin_count[BVH_BINS];
+			float right_area[BVH_BINS];
+			bitu32 right_count[BVH_BINS];
+			bvh_box_t box;
+			bitu32 n;
+			int b;
+
+			if (extent <= 0.0f)
+				continue;
+			float scale = BVH_BINS / extent;
+
+			for (b = 0; b < BVH_BINS; b++) {
+				box_clear(bin_bounds[b]);
+				bin_count[b] = 0;
+			}
+			for (i = first; i < first + count; i++) {
+				bitu32 tri = build.order[i];
+
+				b = get_bin(build.centroids[tri * 3 + k], centroid_bounds.min[k], scale);
+				box_grow(bin_bounds[b], build.bounds[tri]);
+				bin_count[b]++;
+			}
+
+			// right_*[b] covers the bins b to BVH_BINS - 1
+			box_clear(box);
+			n = 0;
+			for (b = BVH_BINS - 1; b > 0; b--) {
+				box_grow(box, bin_bounds[b]);
+				n += bin_count[b];
+				right_area[b] = box_area(box);
+				right_count[b] = n;
+			}
+			box_clear(box);
+			n = 0;
+			for (b = 1; b < BVH_BINS; b++) {
+				box_grow(box, bin_bounds[b - 1]);
+				n += bin_count[b - 1];
+				if ((n == 0) || (right_count[b] == 0))
+					continue;
+
+				float cost = n * box_area(box) + right_count[b] * right_area[b];
+
+				if (cost < best_cost) {
+					best_cost = cost;
+					best_axis = k;
+					best_split = b;
+				}
+			}
+		}
+	}
+
+	// one traversal step is assumed to cost as much as one triangle test
+	float leaf_cost = count * box_area(bounds);
+
+	best_cost += box_area(bounds);
+	if ((count <= BVH_MAX_LEAF) && ((best_axis < 0) || (best_cost >= leaf_cost)))
+		return;
+
+	bitu32 middle;
+
+	if (best_axis >= 0) {
+		bvh_left_of_split pred;
+
+		pred.centroids = &build.centroids[0];
+		pred.axis = best_axis;
+		pred.min = centroid_bounds.min[best_axis];
+		pred.scale = BVH_BINS / (centroid_bounds.max[best_axis] - centroid_bounds.min[best_axis]);
+		pred.split = best_split;
+		middle = std::partition(build.order.begin() + first, build.order.begin() + first + count, pred) - build.order.begin();
+	} else {
+		// all centroids are equal or the tree is too deep, the order does not matter
+		middle = first + count / 2;
+	}
+	if ((middle == first) || (middle == first + count))
+		middle = first + count / 2;
+
+	bitu32 left = build.nodes.size();
+
+	build.nodes.resize(left + 2);
+	build.nodes[node].first = left;
+	build.nodes[node].count = 0;
+	build_node(build, left, first, middle - first, depth + 1);
+	build_node(build, left + 1, middle, first + count - middle, depth + 1);
+}
+
+/** \brief builds the BVH over bvh.triangles.
+  *
+  * The triangles get reordered so that every leaf references a contiguous range of them.
+  */
+void vt_build_bvh(vt_bvh_t & bvh)
+{
+	bitu32 num_triangles = bvh.triangles.size();
+	bvh_build_t build;
+	bitu32 i;
+	int k;
+
+	bvh.nodes.resize(0);
+	if (num_triangles == 0)
+		return;
+
+	build.bounds.resize(num_triangles);
+	build.centroids.resize(num_triangles * 3);
+	build.order.resize(num_triangles);
+	for (i = 0; i < num_triangles; i++) {
+		triangle_bounds(bvh.triangles[i], build.bounds[i]);
+		for (k = 0; k < 3; k++)
+			build.centroids[i * 3 + k] = (build.bounds[i].min[k] + build.bounds[i].max[k]) * 0.5f;
+		build.order[i] = i;
+	}
+	build.nodes.reserve(num_triangles * 2);
+	build.nodes.resize(1);
+	build_node(build, 0, 0, num_triangles, 0);
+
+	vt_bvh_triangle_array_t sorted(num_triangles);
+
+	for (i = 0; i < num_triangles; i++)
+		sorted[i] = bvh.triangles[build.order[i]];
+	bvh.triangles.swap(sorted);
+
+	bvh.nodes.resize(build.nodes.size());
+	for (i = 0; i < build.nodes.size(); i++)
+		bvh.nodes[i] = build.nodes[i];
+}
+
+/// \brief ray data prepared for the node tests.
+typedef struct {
+	float origin[4];
+	float dir[3];
+	float inv_dir[4];
+} bvh_ray_t;
+
+static void setup_ray(bvh_ray_t & ray, const vec3_t & origin, const vec3_t & dir)
+{
+	const float d[3] = { dir.x, dir.y, dir.z };
+	int k;
+
+	ray.origin[0] = origin.x;
+	ray.origin[1] = origin.y;
+	ray.origin[2] = origin.z;
+	ray.origin[3] = 0.0f;
+	for (k = 0; k < 3; k++) {
+		ray.dir[k] = d[k];
+		if (fabs(d[k]) > 1e-30f)
+			ray.inv_dir[k] = 1.0f / d[k];
+		else
+			ray.inv_dir[k] = (d[k] < 0.0f) ? -BVH_INV_LARGE : BVH_INV_LARGE;
+	}
+	ray.inv_dir[3] = 0.0f;
+}
+
+/** \brief slab test of a ray against a node.
+  *
+  * Returns true if the ray enters the node between 0 and max_t, t_near is set to the entry distance.
+  */
+static inline bool ray_node(const bvh_ray_t & ray, const vt_bvh_node_t & node, float max_t, float &t_near)
+{
+#ifdef VT_SSE2
+	__m128 o = _mm_loadu_ps(ray.origin);
+	__m128 inv = _mm_loadu_ps(ray.inv_dir);
+	// the fourth lane holds first / count and is left out of the reductions below
+	__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.min), o), inv);
+	__m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.max), o), inv);
+	__m128 lo = _mm_min_ps(t1, t2);
+	__m128 hi = _mm_max_ps(t1, t2);
+	__m128 t_min, t_max;
+
+	t_min = _mm_max_ss(lo, _mm_shuffle_ps(lo, lo, _MM_SHUFFLE(1, 1, 1, 1)));
+	t_min = _mm_max_ss(t_min, _mm_shuffle_ps(lo, lo, _MM_SHUFFLE(2, 2, 2, 2)));
+	t_min = _mm_max_ss(t_min, _mm_setzero_ps());
+	t_max = _mm_min_ss(hi, _mm_shuffle_ps(hi, hi, _MM_SHUFFLE(1, 1, 1, 1)));
+	t_max = _mm_min_ss(t_max, _mm_shuffle_ps(hi, hi, _MM_SHUFFLE(2, 2, 2, 2)));
+	t_max = _mm_min_ss(t_max, _mm_set_ss(max_t));
+	_mm_store_ss(&t_near, t_min);
+
+	return _mm_comile_ss(t_min, t_max) != 0;
+#else
+	float t_min = 0.0f;
+	float t_max = max_t;
+	int k;
+
+	for (k = 0; k < 3; k++) {
+		float t1 = (node.min[k] - ray.origin[k]) * ray.inv_dir[k];
+		float t2 = (node.max[k] - ray.origin[k]) * ray.inv_dir[k];
+
+		if (t1 > t2)
+			std::swap(t1, t2);
+		if (t1 > t_min)
+			t_min = t1;
+		if (t2 < t_max)
+			t_max = t2;
+	}
+	t_near = t_min;
+
+	return t_min <= t_max;
+#endif
+}
+
+/** \brief ray / triangle test (Moeller-Trumbore).
+  *
+  * Both sides of the triangle count. t, u and v are only set on a hit between 0 and max_t.
+  */
+static inline bool ray_triangle(const bvh_ray_t & ray, const vt_bvh_triangle_t & tri, float max_t, float &t, float &u, float &v)
+{
+	const float *d = ray.dir;
+	float p[3], s[3], q[3];
+	float det, inv_det, tu, tv, tt;
+
+	p[0] = d[1] * tri.e2[2] - d[2] * tri.e2[1];
+	p[1] = d[2] * tri.e2[0] - d[0] * tri.e2[2];
+	p[2] = d[0] * tri.e2[1] - d[1] * tri.e2[0];
+	det = tri.e1[0] * p[0] + tri.e1[1] * p[1] + tri.e1[2] * p[2];
+	if (fabs(det) < 1e-12f)
+		return false;
+	inv_det = 1.0f / det;
+
+	s[0] = ray.origin[0] - tri.v0[0];
+	s[1] = ray.origin[1] - tri.v0[1];
+	s[2] = ray.origin[2] - tri.v0[2];
+	tu = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inv_det;
+	if ((tu < 0.0f) || (tu > 1.0f))
+		return false;
+
+	q[0] = s[1] * tri.e1[2] - s[2] * tri.e1[1];
+	q[1] = s[2] * tri.e1[0] - s[0] * tri.e1[2];
+	q[2] = s[0] * tri.e1[1] - s[1] * tri.e1[0];
+	tv = (d[0] * q[0] + d[1] * q[1] + d[2] * q[2]) * inv_det;
+	if ((tv < 0.0f) || (tu + tv > 1.0f))
+		return false;
+
+	tt = (tri.e2[0] * q[0] + tri.e2[1] * q[1] + tri.e2[2] * q[2]) * inv_det;
+	if ((tt < 0.0f) || (tt > max_t))
+		return false;
+
+	t = tt;
+	u = tu;
+	v = tv;
+	return true;
+}
+
+/** \brief walks the BVH along a ray.
+  *
+  * Children are visited near first, subtrees behind the closest hit so far get skipped. With
+  * any_hit the walk stops at the first hit.
+  */
+static bool trace(vt_bvh_t & bvh, const bvh_ray_t & ray, bool any_hit, vt_bvh_hit_t & hit)
+{
+	bitu32 stack[BVH_STACK_SIZE];
+	float stack_t[BVH_STACK_SIZE];
+	bitu32 sp = 0;
+	bitu32 node = 0;
+	float t_near;
+
+	if (bvh.nodes.empty())
+		return false;
+
+	const vt_bvh_node_t *nodes = &bvh.nodes[0];
+	const vt_bvh_triangle_t *triangles = &bvh.triangles[0];
+
+	if (!ray_node(ray, nodes[0], hit.t, t_near))
+		return false;
+
+	for (;;) {
+		const vt_bvh_node_t & n = nodes[node];
+
+		if (n.count > 0) {
+			bitu32 i;
+
+			for (i = n.first; i < n.first + n.count; i++) {
+				if (ray_triangle(ray, triangles[i], hit.t, hit.t, hit.u, hit.v)) {
+					hit.triangle = i;
+					if (any_hit)
+						return true;
+				}
+			}
+		} else {
+			bitu32 c0 = n.first;
+			bitu32 c1 = n.first + 1;
+			float t0, t1;
+			bool h0 = ray_node(ray, nodes[c0], hit.t, t0);
+			bool h1 = ray_node(ray, nodes[c1], hit.t, t1);
+
+			if (h0 && h1) {
+				if (t1 < t0) {
+					std::swap(c0, c1);
+					std::swap(t0, t1);
+				}
+				stack[sp] = c1;
+				stack_t[sp] = t1;
+				sp++;
+				node = c0;
+				continue;
+			}
+			if (h0) {
+				node = c0;
+				continue;
+			}
+			if (h1) {
+				node = c1;
+				continue;
+			}
+		}
+
+		// next subtree which is not behind the closest hit
+		do {
+			if (sp == 0)
+				return hit.triangle != VT_BVH_NONE;
+			sp--;
+		} while (stack_t[sp] > hit.t);
+		node = stack[sp];
+	}
+}
+
+/** \brief finds the closest triangle hit by a ray.
+  *
+  * Hits are searched between origin and origin + dir * max_t. Returns false if there is none,
+  * hit.triangle is VT_BVH_NONE then.
+  */
+bool vt_bvh_raycast(vt_bvh_t & bvh, const vec3_t & origin, const vec3_t & dir, float max_t, vt_bvh_hit_t & hit)
+{
+	bvh_ray_t ray;
+
+	hit.t = max_t;
+	hit.u = hit.v = 0.0f;
+	hit.triangle = VT_BVH_NONE;
+	setup_ray(ray, origin, dir);
+
+	return trace(bvh, ray, false, hit);
+}
+
+/** \brief tests if the segment from -> to crosses any triangle.
+  *
+  * Returns true if the segment is blocked, for line of sight checks.
+  */
+bool vt_bvh_segment(vt_bvh_t & bvh, const vec3_t & from, const vec3_t & to)
+{
+	bvh_ray_t ray;
+	vt_bvh_hit_t hit;
+
+	hit.t = 1.0f;
+	hit.triangle = VT_BVH_NONE;
+	setup_ray(ray, from, to - from);
+
+	return trace(bvh, ray, true, hit);
+}
+
+/// \brief tests if a node overlaps a box.
+static inline bool box_node(const float *min, const float *max, const vt_bvh_node_t & node)
+{
+#ifdef VT_SSE2
+	__m128 a = _mm_cmple_ps(_mm_loadu_ps(node.min), _mm_loadu_ps(max));
+	__m128 b = _mm_cmple_ps(_mm_loadu_ps(min), _mm_loadu_ps(node.max));
+
+	return (_mm_movemask_ps(_mm_and_ps(a, b)) & 7) == 7;
+#else
+	return (node.min[0] <= max[0]) && (node.min[1] <= max[1]) && (node.min[2] <= max[2]) &&
+	    (min[0] <= node.max[0]) && (min[1] <= node.max[1]) && (min[2] <= node.max[2]);
+#endif
+}
+
+/** \brief finds all triangles whose bounds overlap a box.
+  *
+  * Writes the triangle indices to the start of result (which grows if needed) and returns how
+  * many were found.
+  */
+bitu32 vt_bvh_query_box(vt_bvh_t & bvh, const vec3_t & min, const vec3_t & max, bitu32_array_t & result)
+{
+	// 4 floats each so the SSE2 loads stay inside
+	const float box_min[4] = { min.x, min.y, min.z, 0.0f };
+	const float box_max[4] = { max.x, max.y, max.z, 0.0f };
+	bitu32 stack[BVH_STACK_SIZE];
+	bitu32 sp = 0;
+	bitu32 count = 0;
+
+	if (bvh.nodes.empty())
+		return 0;
+
+	const vt_bvh_node_t *nodes = &bvh.nodes[0];
+
+	stack[sp++] = 0;
+	while (sp > 0) {
+		const vt_bvh_node_t & n = nodes[stack[--sp]];
+
+		if (!box_node(box_min, box_max, n))
+			continue;
+		if (n.count == 0) {
+			stack[sp++] = n.first;
+			stack[sp++] = n.first + 1;
+			continue;
+		}
+
+		bitu32 i;
+
+		for (i = n.first; i < n.first + n.count; i++) {
+			bvh_box_t box;
+			int k;
+
+			triangle_bounds(bvh.triangles[i], box);
+			for (k = 0; k < 3; k++)
+				if ((box.min[k] > box_max[k]) || (box.max[k] < box_min[k]))
+					break;
+			if (k < 3)
+				continue;
+			if (count >= result.size())
+				result.resize((count < 16) ? 32 : count * 2);
+			result[count++] = i;
+		}
+	}
+
+	return count;
+}
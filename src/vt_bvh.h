@@ -0,0 +1,57 @@
+#ifndef _VT_BVH_H_
+#define _VT_BVH_H_
+
+#include "tr_types.h"
+
+#define VT_BVH_NONE 0xffffffff	///< \brief no triangle / no static mesh.
+
+/** \brief World space triangle of the BVH.
+  *
+  * Stored as one corner and two edges, which is what the ray test needs.
+  */
+typedef struct {
+	float v0[3];		///< \brief first corner.
+	float e1[3];		///< \brief second corner - first corner.
+	float e2[3];		///< \brief third corner - first corner.
+	bitu32 room;		///< \brief room the triangle belongs to.
+	bitu32 static_mesh;	///< \brief index into the static_meshes of that room, VT_BVH_NONE for room geometry.
+} vt_bvh_triangle_t;
+typedef prtl::array < vt_bvh_triangle_t > vt_bvh_triangle_array_t;
+
+/** \brief BVH node, 32 bytes.
+  *
+  * Leaves have count > 0 and hold triangles[first] up to (excluding) triangles[first + count].
+  * Inner nodes have count == 0, their children are nodes[first] and nodes[first + 1].
+  */
+typedef struct {
+	float min[3];		///< \brief lower corner of the bounds.
+	bitu32 first;		///< \brief first triangle or first child.
+	float max[3];		///< \brief upper corner of the bounds.
+	bitu32 count;		///< \brief number of triangles, 0 for inner nodes.
+} vt_bvh_node_t;
+typedef prtl::array < vt_bvh_node_t > vt_bvh_node_array_t;
+
+/** \brief Bounding volume hierarchy over triangles.
+  *
+  * The nodes are stored in one array, nodes[0] is the root. The two children of an inner node
+  * are siblings, nodes[first] and nodes[first + 1]. Empty if there are no triangles.
+  */
+typedef struct {
+	vt_bvh_node_array_t nodes;	///< \brief all nodes.
+	vt_bvh_triangle_array_t triangles;	///< \brief triangles in leaf order.
+} vt_bvh_t;
+
+/// \brief Result of a ray query.
+typedef struct {
+	float t;		///< \brief distance along the ray in units of the direction length.
+	float u;		///< \brief barycentric coordinate of the second corner.
+	float v;		///< \brief barycentric coordinate of the third corner.
+	bitu32 triangle;	///< \brief index into triangles, VT_BVH_NONE if nothing was hit.
+} vt_bvh_hit_t;
+
+void vt_build_bvh(vt_bvh_t & bvh);
+bool vt_bvh_raycast(vt_bvh_t & bvh, const vec3_t & origin, const vec3_t & dir, float max_t, vt_bvh_hit_t & hit);
+bool vt_bvh_segment(vt_bvh_t & bvh, const vec3_t & from, const vec3_t & to);
+bitu32 vt_bvh_query_box(vt_bvh_t & bvh, const vec3_t & min, const vec3_t & max, bitu32_array_t & result);
+
+#endif // _VT_BVH_H_
@@ -0,0 +1,325 @@
+/*
+ * Copyright 2002 - Florian Schulze <crow@icculus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * This file is part of vt.
+ *
+ */
+
+#include <string.h>
+#include "vt_simd.h"
+#include "vt_dxt.h"
+#ifdef VT_SSE2
+#include <emmintrin.h>
+#endif
+
+#define RCSID "$Id$"
+
+/** \brief checks if any of count RGBA8 texels is not fully opaque.
+  *
+  * Decides between BC1 and BC3; the transparency_flags of the object textures are not enough,
+  * as the colour key of the 8-bit textiles ends up in the alpha of every page which uses it.
+  */
+bool vt_dxt_has_alpha(const bitu32 *src, bitu32 count)
+{
+	const bitu8 *p = (const bitu8 *)src;
+	bitu32 i = 0;
+	bitu8 alpha = 255;
+#ifdef VT_SSE2
+	__m128i acc = _mm_set1_epi8((char)0xff);
+
+	for (; i + 4 <= count; i += 4)
+		acc = _mm_min_epu8(acc, _mm_loadu_si128((const __m128i *)&src[i]));
+	acc = _mm_min_epu8(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+	acc = _mm_min_epu8(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+	alpha = (bitu8)((bitu32)_mm_cvtsi128_si32(acc) >> 24);
+#endif
+	for (; i < count; i++)
+		if (p[i * 4 + 3] < alpha)
+			alpha = p[i * 4 + 3];
+
+	return alpha != 255;
+}
+
+/// \brief returns the bytes of one mipmap level of size * size texels in format.
+bitu32 vt_dxt_size(vt_dxt_format_e format, bitu32 size)
+{
+	bitu32 blocks = (size + 3) / 4;
+
+	switch (format) {
+	case VT_DXT_BC1:
+		return blocks * blocks * 8;
+	case VT_DXT_BC3:
+		return blocks * blocks * 16;
+	default:
+		return size * size * 4;
+	}
+}
+
+/// \brief copies the 4x4 block at bx, by, levels smaller than 4x4 repeat their last row and column.
+static void load_block(const bitu32 *src, bitu32 size, bitu32 bx, bitu32 by, bitu32 *block)
+{
+	bitu32 x, y;
+
+	for (y = 0; y < 4; y++)
+		for (x = 0; x < 4; x++)
+			block[y * 4 + x] = src[((by + y < size) ? by + y : size - 1) * size + ((bx + x < size) ? bx + x : size - 1)];
+}
+
+/// \brief packs an RGB colour to 5:6:5.
+static bitu16 to_565(const bitu8 *c)
+{
+	return (bitu16)((((c[0] * 31 + 127) / 255) << 11) | (((c[1] * 63 + 127) / 255) << 5) | ((c[2] * 31 + 127) / 255));
+}
+
+/// \brief unpacks a 5:6:5 colour like the decoder does.
+static void from_565(bitu16 v, bitu8 *c)
+{
+	bitu8 r = (bitu8)(v >> 11), g = (bitu8)((v >> 5) & 63), b = (bitu8)(v & 31);
+
+	c[0] = (bitu8)((r << 3) | (r >> 2));
+	c[1] = (bitu8)((g << 2) | (g >> 4));
+	c[2] = (bitu8)((b << 3) | (b >> 2));
+	c[3] = 0;
+}
+
+/** \brief finds the closest palette colour of every texel of a block.
+  *
+  * Compares r, g and b by the squared distance, the first of equally close colours wins.
+  * Returns the 2-bit indices of the 16 texels, texel 0 in the lowest bits. Both code paths
+  * give the same result.
+  */
+static bitu32 colour_indices(const bitu32 *block, const bitu32 *palette)
+{
+	bitu32 indices = 0;
+	int row;
+#ifdef VT_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i rgb = _mm_set1_epi32(0x00ffffff);
+	const __m128i shifts = _mm_set_epi16(0, 64, 0, 16, 0, 4, 0, 1);
+	__m128i colours[4];
+	int i;
+
+	for (i = 0; i < 4; i++)
+		colours[i] = _mm_unpacklo_epi8(_mm_set1_epi32((int)palette[i]), zero);
+
+	for (row = 0; row < 4; row++) {
+		__m128i texels = _mm_and_si128(_mm_loadu_si128((const __m128i *)&block[row * 4]), rgb);
+		__m128i lo = _mm_unpacklo_epi8(texels, zero);
+		__m128i hi = _mm_unpackhi_epi8(texels, zero);
+		__m128i best = _mm_setzero_si128(), index = _mm_setzero_si128();
+
+		for (i = 0; i < 4; i++) {
+			__m128i dlo = _mm_sub_epi16(lo, colours[i]);
+			__m128i dhi = _mm_sub_epi16(hi, colours[i]);
+			__m128 slo = _mm_castsi128_ps(_mm_madd_epi16(dlo, dlo));	// r + g, b + a of texels 0 and 1
+			__m128 shi = _mm_castsi128_ps(_mm_madd_epi16(dhi, dhi));
+			__m128i dist = _mm_add_epi32(_mm_castps_si128(_mm_shuffle_ps(slo, shi, _MM_SHUFFLE(2, 0, 2, 0))),
+						     _mm_castps_si128(_mm_shuffle_ps(slo, shi, _MM_SHUFFLE(3, 1, 3, 1))));
+
+			if (i == 0) {
+				best = dist;
+			} else {
+				__m128i closer = _mm_cmplt_epi32(dist, best);
+
+				best = _mm_or_si128(_mm_and_si128(closer, dist), _mm_andnot_si128(closer, best));
+				index = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(i)), _mm_andnot_si128(closer, index));
+			}
+		}
+		// index << (2 * texel), then add up the four texels
+		index = _mm_mullo_epi16(index, shifts);
+		index = _mm_add_epi32(index, _mm_shuffle_epi32(index, _MM_SHUFFLE(2, 3, 0, 1)));
+		index = _mm_add_epi32(index, _mm_shuffle_epi32(index, _MM_SHUFFLE(1, 0, 3, 2)));
+		indices |= (bitu32)_mm_cvtsi128_si32(index) << (row * 8);
+	}
+#else
+	for (row = 0; row < 4; row++) {
+		int x;
+
+		for (x = 0; x < 4; x++) {
+			const bitu8 *t = (const bitu8 *)&block[row * 4 + x];
+			bit32 best = 0;
+			bitu32 index = 0, i;
+
+			for (i = 0; i < 4; i++) {
+				const bitu8 *c = (const bitu8 *)&palette[i];
+				bit32 dr = t[0] - c[0], dg = t[1] - c[1], db = t[2] - c[2];
+				bit32 dist = dr * dr + dg * dg + db * db;
+
+				if ((i == 0) || (dist < best)) {
+					best = dist;
+					index = i;
+				}
+			}
+			indices |= index << ((row * 4 + x) * 2);
+		}
+	}
+#endif
+
+	return indices;
+}
+
+/** \brief encodes the colour of a block, 8 bytes.
+  *
+  * The end points are the corners of the bounding box of the colours, moved inwards by a
+  * sixteenth of its size (Waveren, Real-Time DXT Compression). The first end point is always
+  * the larger one, so BC1 blocks use four colours and no transparent black.
+  */
+static void encode_colour(const bitu32 *block, bitu8 *dst)
+{
+	bitu8 lo[4], hi[4];
+	bitu32 palette[4], indices;
+	bitu16 c0, c1, t;
+	bitu8 *p0 = (bitu8 *)&palette[0], *p1 = (bitu8 *)&palette[1];
+	bitu8 *p2 = (bitu8 *)&palette[2], *p3 = (bitu8 *)&palette[3];
+	int c;
+#ifdef VT_SSE2
+	__m128i r0 = _mm_loadu_si128((const __m128i *)&block[0]);
+	__m128i r1 = _mm_loadu_si128((const __m128i *)&block[4]);
+	__m128i r2 = _mm_loadu_si128((const __m128i *)&block[8]);
+	__m128i r3 = _mm_loadu_si128((const __m128i *)&block[12]);
+	__m128i vmin = _mm_min_epu8(_mm_min_epu8(r0, r1), _mm_min_epu8(r2, r3));
+	__m128i vmax = _mm_max_epu8(_mm_max_epu8(r0, r1), _mm_max_epu8(r2, r3));
+	bitu32 packed;
+
+	vmin = _mm_min_epu8(vmin, _mm_shuffle_epi32(vmin, _MM_SHUFFLE(2, 3, 0, 1)));
+	vmin = _mm_min_epu8(vmin, _mm_shuffle_epi32(vmin, _MM_SHUFFLE(1, 0, 3, 2)));
+	vmax = _mm_max_epu8(vmax, _mm_shuffle_epi32(vmax, _MM_SHUFFLE(2, 3, 0, 1)));
+	vmax = _mm_max_epu8(vmax, _mm_shuffle_epi32(vmax, _MM_SHUFFLE(1, 0, 3, 2)));
+	packed = (bitu32)_mm_cvtsi128_si32(vmin);
+	memcpy(lo, &packed, 4);
+	packed = (bitu32)_mm_cvtsi128_si32(vmax);
+	memcpy(hi, &packed, 4);
+#else
+	int i;
+
+	memcpy(lo, &block[0], 4);
+	memcpy(hi, &block[0], 4);
+	for (i = 1; i < 16; i++) {
+		const bitu8 *t = (const bitu8 *)&block[i];
+
+		for (c = 0; c < 4; c++) {
+			if (t[c] < lo[c])
+				lo[c] = t[c];
+			if (t[c] > hi[c])
+				hi[c] = t[c];
+		}
+	}
+#endif
+	for (c = 0; c < 3; c++) {
+		bitu8 inset = (bitu8)((hi[c] - lo[c]) >> 4);
+
+		lo[c] += inset;
+		hi[c] -= inset;
+	}
+
+	c0 = to_565(hi);
+	c1 = to_565(lo);
+	if (c0 < c1) {
+		t = c0;
+		c0 = c1;
+		c1 = t;
+	}
+	from_565(c0, p0);
+	from_565(c1, p1);
+	for (c = 0; c < 4; c++) {
+		p2[c] = (bitu8)((2 * p0[c] + p1[c]) / 3);
+		p3[c] = (bitu8)((p0[c] + 2 * p1[c]) / 3);
+	}
+	// equal end points make all palette colours equal, every index is 0 then
+	indices = colour_indices(block, palette);
+
+	dst[0] = (bitu8)c0;
+	dst[1] = (bitu8)(c0 >> 8);
+	dst[2] = (bitu8)c1;
+	dst[3] = (bitu8)(c1 >> 8);
+	dst[4] = (bitu8)indices;
+	dst[5] = (bitu8)(indices >> 8);
+	dst[6] = (bitu8)(indices >> 16);
+	dst[7] = (bitu8)(indices >> 24);
+}
+
+/** \brief encodes the alpha of a block, 8 bytes.
+  *
+  * The end points are the exact minimum and maximum, so the colour key stays 0 and opaque
+  * texels stay 255.
+  */
+static void encode_alpha(const bitu32 *block, bitu8 *dst)
+{
+	bitu8 alpha[16], palette[8], lo = 255, hi = 0;
+	bitu32 bits[2] = { 0, 0 };
+	int i, j;
+
+	for (i = 0; i < 16; i++) {
+		alpha[i] = ((const bitu8 *)&block[i])[3];
+		if (alpha[i] < lo)
+			lo = alpha[i];
+		if (alpha[i] > hi)
+			hi = alpha[i];
+	}
+
+	dst[0] = hi;
+	dst[1] = lo;
+	if (hi > lo) {
+		// eight alpha mode
+		palette[0] = hi;
+		palette[1] = lo;
+		for (j = 1; j < 7; j++)
+			palette[j + 1] = (bitu8)(((7 - j) * hi + j * lo) / 7);
+		for (i = 0; i < 16; i++) {
+			int best = 256;
+			bitu32 index = 0;
+
+			for (j = 0; j < 8; j++) {
+				int dist = (alpha[i] > palette[j]) ? alpha[i] - palette[j] : palette[j] - alpha[i];
+
+				if (dist < best) {
+					best = dist;
+					index = j;
+				}
+			}
+			bits[i / 8] |= index << ((i % 8) * 3);
+		}
+	}
+	for (i = 0; i < 2; i++) {
+		dst[2 + i * 3] = (bitu8)bits[i];
+		dst[3 + i * 3] = (bitu8)(bits[i] >> 8);
+		dst[4 + i * 3] = (bitu8)(bits[i] >> 16);
+	}
+}
+
+/** \brief compresses a square RGBA8 image.
+  *
+  * src is size * size texels (memory order r, g, b, a), dst gets vt_dxt_size(format, size)
+  * bytes. BC1 ignores the alpha. The blocks run left to right, top to bottom like the rows
+  * of src, as OpenGL expects them.
+  */
+void vt_dxt_encode(vt_dxt_format_e format, const bitu32 *src, bitu32 size, bitu8 *dst)
+{
+	bitu32 block[16];
+	bitu32 x, y;
+
+	for (y = 0; y < size; y += 4)
+		for (x = 0; x < size; x += 4) {
+			load_block(src, size, x, y, block);
+			if (format == VT_DXT_BC3) {
+				encode_alpha(block, dst);
+				dst += 8;
+			}
+			encode_colour(block, dst);
+			dst += 8;
+		}
+}
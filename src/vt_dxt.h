@@ -0,0 +1,21 @@
+#ifndef _VT_DXT_H_
+#define _VT_DXT_H_
+
+#include "tr_types.h"
+
+/** \brief Block compressed texture formats.
+  *
+  * Both store 4x4 texel blocks. BC1 (DXT1) keeps the colour at 8 bytes per block and has no
+  * alpha, BC3 (DXT5) adds 8 bytes of interpolated alpha.
+  */
+typedef enum {
+	VT_DXT_NONE,		///< \brief uncompressed RGBA8.
+	VT_DXT_BC1,		///< \brief GL_COMPRESSED_RGB_S3TC_DXT1_EXT.
+	VT_DXT_BC3		///< \brief GL_COMPRESSED_RGBA_S3TC_DXT5_EXT.
+} vt_dxt_format_e;
+
+bool vt_dxt_has_alpha(const bitu32 *src, bitu32 count);
+bitu32 vt_dxt_size(vt_dxt_format_e format, bitu32 size);
+void vt_dxt_encode(vt_dxt_format_e format, const bitu32 *src, bitu32 size, bitu8 *dst);
+
+#endif // _VT_DXT_H_
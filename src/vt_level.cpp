@@ -1,9 +1,27 @@
 #include "SDL.h"
 #include "SDL_endian.h"
+#include <math.h>
+#include <float.h>
+#include <string.h>
+#include <map>
+#include <algorithm>
+#include <vector>
 #include "vt_level.h"
 
 #define RCSID "$Id: vt_level.cpp,v 1.1 2002/09/20 15:59:02 crow Exp $"
 
+VT_Level::VT_Level()
+{
+	compact_geometry = false;
+	memset(&dedup_report, 0, sizeof(dedup_report));
+	atlas_page_size = 0;
+	atlas.page_size = 0;
+	atlas.padding = 0;
+	room_grid.min_x = room_grid.min_z = 0;
+	room_grid.size_x = room_grid.size_z = 0;
+	room_grid.cell_size = 1024.0f;
+}
+
 void VT_Level::prepare_level()
 {
 	bitu32 i;
@@ -20,41 +38,1002 @@ void VT_Level::prepare_level()
 		for (i = 0; i < num_textiles; i++)
 			convert_textile8_to_textile32(textile8[i], palette, textile32[i]);
 	}
+
+	dedup_report.bytes_saved = 0;
+	dedup_meshes();
+	dedup_textiles();
+
+	if (atlas_page_size > 0)
+		vt_build_atlas(textile32, sprite_textures, atlas_page_size, 8, atlas);
+	build_object_texture_uvs();
+	build_id_lookups();
+	vt_build_room_grid(rooms, room_grid);
+	vt_build_room_graph(rooms, room_graph);
+
+	room_vertices.resize(rooms.size());
+	for (i = 0; i < rooms.size(); i++)
+		build_room_vertices(rooms[i], room_vertices[i]);
+	build_batches();
+	build_room_items();
+	build_moveable_boxes();
+	build_bvh();
 }
 
-tr_staticmesh_t *VT_Level::find_staticmesh_id(bitu32 object_id)
+/// \brief clamps a float colour component to 0-255.
+static bitu8 colour_to_byte(float c)
+{
+	if (c <= 0.0f)
+		return 0;
+	if (c >= 1.0f)
+		return 255;
+	return (bitu8)(c * 255.0f + 0.5f);
+}
+
+/// \brief clamps a normal component to -127-127.
+static bit8 normal_to_byte(float n)
+{
+	if (n <= -1.0f)
+		return -127;
+	if (n >= 1.0f)
+		return 127;
+	return (bit8)(n * 127.0f);
+}
+
+/** \brief splits the room vertices into separate streams.
+  *
+  * Colours get clamped like OpenGL would do with qglColor3f. room.vertices gets freed.
+  */
+void VT_Level::build_room_vertices(tr5_room_t & room, vt_room_vertices_t & dst)
 {
 	bitu32 i;
 
-	for (i = 0; i < static_meshes.size(); i++)
-		if (static_meshes[i].object_id == object_id)
-			return &static_meshes[i];
+	dst.num_vertices = room.vertices.size();
+	dst.positions.resize(dst.num_vertices);
+	dst.colours.resize(dst.num_vertices);
+	dst.normals.resize(dst.num_vertices);
 
-	return NULL;
+	bool has_normals = false;
+
+	for (i = 0; i < dst.num_vertices; i++) {
+		tr5_room_vertex_t & vert = room.vertices[i];
+		vt_vec4_t & p = dst.positions[i];
+		tr2_colour_t & c = dst.colours[i];
+		vt_normal8_t & n = dst.normals[i];
+
+		p.x = vert.vertex.x;
+		p.y = vert.vertex.y;
+		p.z = vert.vertex.z;
+		p.w = 1.0f;
+
+		c.r = colour_to_byte(vert.colour.r);
+		c.g = colour_to_byte(vert.colour.g);
+		c.b = colour_to_byte(vert.colour.b);
+		c.a = colour_to_byte(vert.colour.a);
+
+		n.x = normal_to_byte(vert.normal.x);
+		n.y = normal_to_byte(vert.normal.y);
+		n.z = normal_to_byte(vert.normal.z);
+		n.w = 0;
+		if (n.x || n.y || n.z)
+			has_normals = true;
+	}
+
+	if (dst.num_vertices > 0)
+		vt_bounds_vec4(&dst.positions[0], dst.num_vertices, dst.bbox_min, dst.bbox_max);
+	else
+		dst.bbox_min = dst.bbox_max = vt_vec4_t();
+
+	dst.origin = vt_vec4_t();
+	if (!has_normals)
+		dst.normals.resize(0);
+	if (compact_geometry && compact_room_vertices(dst))
+		dst.positions.resize(0);
+	// the streams hold everything needed from now on
+	room.vertices.resize(0);
 }
 
-tr2_item_t *VT_Level::find_item_id(bit32 object_id)
+/** \brief quantises the positions of a room to 16-bit integers.
+  *
+  * The origin is the centre of the bounding box, so every room up to 64k units in size fits.
+  * This is only done if it is lossless, which is always true for TR1-TR4, where the vertices are
+  * bit16 on disk. Returns false and leaves positions16 empty otherwise.
+  */
+bool VT_Level::compact_room_vertices(vt_room_vertices_t & dst)
 {
 	bitu32 i;
 
-	for (i = 0; i < items.size(); i++)
-		if (items[i].object_id == object_id)
-			return &items[i];
+	if (dst.num_vertices == 0)
+		return false;
 
-	return NULL;
+	dst.origin.x = (float)floor((dst.bbox_min.x + dst.bbox_max.x) * 0.5f);
+	dst.origin.y = (float)floor((dst.bbox_min.y + dst.bbox_max.y) * 0.5f);
+	dst.origin.z = (float)floor((dst.bbox_min.z + dst.bbox_max.z) * 0.5f);
+	dst.origin.w = 0.0f;
+
+	dst.positions16.resize(dst.num_vertices);
+	for (i = 0; i < dst.num_vertices; i++) {
+		vt_vec4_t & p = dst.positions[i];
+		vt_vec4_16_t & q = dst.positions16[i];
+		float x = p.x - dst.origin.x;
+		float y = p.y - dst.origin.y;
+		float z = p.z - dst.origin.z;
+
+		if ((x < -32768.0f) || (x > 32767.0f) || (y < -32768.0f) || (y > 32767.0f) || (z < -32768.0f) || (z > 32767.0f))
+			break;
+		q.x = (bit16)x;
+		q.y = (bit16)y;
+		q.z = (bit16)z;
+		q.w = 1;
+		if (((float)q.x != x) || ((float)q.y != y) || ((float)q.z != z))
+			break;
+	}
+
+	if (i < dst.num_vertices) {
+		dst.positions16.resize(0);
+		dst.origin = vt_vec4_t();
+		return false;
+	}
+
+	return true;
 }
 
-tr_moveable_t *VT_Level::find_moveable_id(bitu32 object_id)
+/** \brief returns the float positions of a room.
+  *
+  * If the room is stored compact, the positions get expanded into scratch, which is resized as needed.
+  */
+const vt_vec4_t *VT_Level::get_room_positions(bitu32 room, vt_vec4_array_t & scratch)
+{
+	vt_room_vertices_t & verts = room_vertices[room];
+
+	if (verts.num_vertices == 0)
+		return NULL;
+	if (verts.positions.size() > 0)
+		return &verts.positions[0];
+	if (verts.positions16.size() == 0)
+		return NULL;	// freed by free_room_streams()
+
+	if (scratch.size() < verts.num_vertices)
+		scratch.resize(verts.num_vertices);
+	vt_expand_vec4_16(&verts.positions16[0], verts.origin, &scratch[0], verts.num_vertices);
+
+	return &scratch[0];
+}
+
+/** \brief frees the room vertex streams once the batches are final.
+  *
+  * The renderers draw from room_batches, the streams are only needed to build the batches
+  * and the BVH. Call it after the last build_batches(). num_vertices, origin and the bounding
+  * boxes are kept; get_room_positions() returns NULL afterwards.
+  */
+void VT_Level::free_room_streams()
+{
+	bitu32 i;
+
+	for (i = 0; i < room_vertices.size(); i++) {
+		vt_room_vertices_t & verts = room_vertices[i];
+
+		verts.positions.resize(0);
+		verts.positions16.resize(0);
+		verts.colours.resize(0);
+		verts.normals.resize(0);
+	}
+}
+
+/// \brief returns the number of bytes used by the room vertex streams.
+bitu32 VT_Level::get_room_vertices_size()
+{
+	bitu32 i;
+	bitu32 size = 0;
+
+	for (i = 0; i < room_vertices.size(); i++) {
+		size += room_vertices[i].positions.size() * sizeof(vt_vec4_t);
+		size += room_vertices[i].positions16.size() * sizeof(vt_vec4_16_t);
+		size += room_vertices[i].colours.size() * sizeof(tr2_colour_t);
+		size += room_vertices[i].normals.size() * sizeof(vt_normal8_t);
+	}
+
+	return size;
+}
+
+/// \brief FNV-1a hash, pass the previous result as hash to continue over several blocks.
+static bitu32 hash_data(const void *data, bitu32 size, bitu32 hash = 2166136261u)
 {
+	const bitu8 *p = (const bitu8 *)data;
 	bitu32 i;
 
-	for (i = 0; i < moveables.size(); i++)
-		if (moveables[i].object_id == object_id)
-			return &moveables[i];
+	for (i = 0; i < size; i++) {
+		hash ^= p[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+/// \brief returns a pointer to count elements of pool starting at offset, NULL if count is 0.
+template < class T > static T *pool_range(prtl::array < T > &pool, bitu32 offset, bitu32 count)
+{
+	if (count == 0)
+		return NULL;
+	pool[offset + count - 1];	// bounds check of the whole range
+
+	return &pool[offset];
+}
+
+/// \brief appends a range of src to dst at pos and moves offset to the new location.
+template < class T > static void move_pool_range(prtl::array < T > &src, bitu32 & offset, bitu32 count, prtl::array < T > &dst, bitu32 & pos)
+{
+	bitu32 i;
+
+	for (i = 0; i < count; i++)
+		dst[pos + i] = src[offset + i];
+	offset = pos;
+	pos += count;
+}
+
+/// \brief hashes the contents of a mesh, including its ranges in the mesh pools.
+bitu32 VT_Level::hash_mesh(tr4_mesh_t & mesh)
+{
+	bitu32 hash;
+
+	hash = hash_data(&mesh.centre, sizeof(mesh.centre));
+	hash = hash_data(&mesh.collision_size, sizeof(mesh.collision_size), hash);
+	hash = hash_data(&mesh.num_vertices, sizeof(mesh.num_vertices), hash);
+	hash = hash_data(&mesh.num_normals, sizeof(mesh.num_normals), hash);
+	hash = hash_data(&mesh.num_lights, sizeof(mesh.num_lights), hash);
+	hash = hash_data(&mesh.num_textured_rectangles, sizeof(mesh.num_textured_rectangles), hash);
+	hash = hash_data(&mesh.num_textured_triangles, sizeof(mesh.num_textured_triangles), hash);
+	hash = hash_data(&mesh.num_coloured_rectangles, sizeof(mesh.num_coloured_rectangles), hash);
+	hash = hash_data(&mesh.num_coloured_triangles, sizeof(mesh.num_coloured_triangles), hash);
+	hash = hash_data(pool_range(mesh_vertices, mesh.vertex_offset, mesh.num_vertices), mesh.num_vertices * sizeof(tr5_vertex_t), hash);
+	hash = hash_data(pool_range(mesh_normals, mesh.normal_offset, mesh.num_normals), mesh.num_normals * sizeof(tr5_vertex_t), hash);
+	hash = hash_data(pool_range(mesh_lights, mesh.light_offset, mesh.num_lights), mesh.num_lights * sizeof(bit16), hash);
+	hash = hash_data(pool_range(mesh_rectangles, mesh.textured_rectangle_offset, mesh.num_textured_rectangles + mesh.num_coloured_rectangles),
+			 (mesh.num_textured_rectangles + mesh.num_coloured_rectangles) * sizeof(tr4_face4_t), hash);
+	hash = hash_data(pool_range(mesh_triangles, mesh.textured_triangle_offset, mesh.num_textured_triangles + mesh.num_coloured_triangles),
+			 (mesh.num_textured_triangles + mesh.num_coloured_triangles) * sizeof(tr4_face3_t), hash);
+
+	return hash;
+}
+
+/// \brief returns true if both meshes have the same contents.
+bool VT_Level::compare_meshes(tr4_mesh_t & a, tr4_mesh_t & b)
+{
+	bitu32 num_rectangles = a.num_textured_rectangles + a.num_coloured_rectangles;
+	bitu32 num_triangles = a.num_textured_triangles + a.num_coloured_triangles;
+
+	if ((a.centre.x != b.centre.x) || (a.centre.y != b.centre.y) || (a.centre.z != b.centre.z) || (a.collision_size != b.collision_size))
+		return false;
+	if ((a.num_vertices != b.num_vertices) || (a.num_normals != b.num_normals) || (a.num_lights != b.num_lights))
+		return false;
+	if ((a.num_textured_rectangles != b.num_textured_rectangles) || (a.num_textured_triangles != b.num_textured_triangles))
+		return false;
+	if ((a.num_coloured_rectangles != b.num_coloured_rectangles) || (a.num_coloured_triangles != b.num_coloured_triangles))
+		return false;
+
+	if (a.num_vertices && memcmp(pool_range(mesh_vertices, a.vertex_offset, a.num_vertices), pool_range(mesh_vertices, b.vertex_offset, b.num_vertices), a.num_vertices * sizeof(tr5_vertex_t)))
+		return false;
+	if (a.num_normals && memcmp(pool_range(mesh_normals, a.normal_offset, a.num_normals), pool_range(mesh_normals, b.normal_offset, b.num_normals), a.num_normals * sizeof(tr5_vertex_t)))
+		return false;
+	if (a.num_lights && memcmp(pool_range(mesh_lights, a.light_offset, a.num_lights), pool_range(mesh_lights, b.light_offset, b.num_lights), a.num_lights * sizeof(bit16)))
+		return false;
+	if (num_rectangles && memcmp(pool_range(mesh_rectangles, a.textured_rectangle_offset, num_rectangles), pool_range(mesh_rectangles, b.textured_rectangle_offset, num_rectangles), num_rectangles * sizeof(tr4_face4_t)))
+		return false;
+	if (num_triangles && memcmp(pool_range(mesh_triangles, a.textured_triangle_offset, num_triangles), pool_range(mesh_triangles, b.textured_triangle_offset, num_triangles), num_triangles * sizeof(tr4_face3_t)))
+		return false;
+
+	return true;
+}
+
+/// \brief returns the number of bytes used by a mesh and its pool ranges.
+bitu32 VT_Level::get_mesh_size(tr4_mesh_t & mesh)
+{
+	return sizeof(tr4_mesh_t) + (mesh.num_vertices + mesh.num_normals) * sizeof(tr5_vertex_t) + mesh.num_lights * sizeof(bit16)
+		+ (mesh.num_textured_rectangles + mesh.num_coloured_rectangles) * sizeof(tr4_face4_t)
+		+ (mesh.num_textured_triangles + mesh.num_coloured_triangles) * sizeof(tr4_face3_t);
+}
+
+/** \brief merges meshes with identical contents.
+  *
+  * The first mesh of each group stays, mesh_indices gets remapped to it and the mesh pools get
+  * rebuilt without the ranges of the removed meshes.
+  */
+void VT_Level::dedup_meshes()
+{
+	std::multimap < bitu32, bitu32 > canonical;	// hash -> index of the first mesh with that contents
+	std::multimap < bitu32, bitu32 >::iterator it;
+	std::vector < bitu32 > remap(meshes.size());
+	std::vector < bitu32 > kept;
+	bitu32 num_vertices = 0, num_normals = 0, num_lights = 0, num_rectangles = 0, num_triangles = 0;
+	bitu32 i;
+
+	dedup_report.meshes_before = meshes.size();
+
+	for (i = 0; i < meshes.size(); i++) {
+		tr4_mesh_t & mesh = meshes[i];
+		bitu32 hash = hash_mesh(mesh);
+
+		for (it = canonical.lower_bound(hash); (it != canonical.end()) && (it->first == hash); ++it)
+			if (compare_meshes(meshes[it->second], mesh))
+				break;
+
+		if ((it != canonical.end()) && (it->first == hash)) {
+			remap[i] = remap[it->second];
+			dedup_report.bytes_saved += get_mesh_size(mesh);
+			continue;
+		}
+
+		canonical.insert(std::make_pair(hash, i));
+		remap[i] = kept.size();
+		kept.push_back(i);
+		num_vertices += mesh.num_vertices;
+		num_normals += mesh.num_normals;
+		num_lights += mesh.num_lights;
+		num_rectangles += mesh.num_textured_rectangles + mesh.num_coloured_rectangles;
+		num_triangles += mesh.num_textured_triangles + mesh.num_coloured_triangles;
+	}
+
+	dedup_report.meshes_after = kept.size();
+	if (kept.size() == meshes.size())
+		return;
+
+	tr4_mesh_array_t new_meshes(kept.size());
+	tr5_vertex_array_t new_vertices(num_vertices);
+	tr5_vertex_array_t new_normals(num_normals);
+	bit16_array_t new_lights(num_lights);
+	tr4_face4_array_t new_rectangles(num_rectangles);
+	tr4_face3_array_t new_triangles(num_triangles);
+	bitu32 vertex_pos = 0, normal_pos = 0, light_pos = 0, rectangle_pos = 0, triangle_pos = 0;
+
+	for (i = 0; i < kept.size(); i++) {
+		tr4_mesh_t mesh = meshes[kept[i]];
+
+		move_pool_range(mesh_vertices, mesh.vertex_offset, mesh.num_vertices, new_vertices, vertex_pos);
+		move_pool_range(mesh_normals, mesh.normal_offset, mesh.num_normals, new_normals, normal_pos);
+		move_pool_range(mesh_lights, mesh.light_offset, mesh.num_lights, new_lights, light_pos);
+		move_pool_range(mesh_rectangles, mesh.textured_rectangle_offset, mesh.num_textured_rectangles, new_rectangles, rectangle_pos);
+		move_pool_range(mesh_rectangles, mesh.coloured_rectangle_offset, mesh.num_coloured_rectangles, new_rectangles, rectangle_pos);
+		move_pool_range(mesh_triangles, mesh.textured_triangle_offset, mesh.num_textured_triangles, new_triangles, triangle_pos);
+		move_pool_range(mesh_triangles, mesh.coloured_triangle_offset, mesh.num_coloured_triangles, new_triangles, triangle_pos);
+		new_meshes[i] = mesh;
+	}
+
+	meshes.swap(new_meshes);
+	mesh_vertices.swap(new_vertices);
+	mesh_normals.swap(new_normals);
+	mesh_lights.swap(new_lights);
+	mesh_rectangles.swap(new_rectangles);
+	mesh_triangles.swap(new_triangles);
+
+	for (i = 0; i < mesh_indices.size(); i++)
+		if (mesh_indices[i] < remap.size())
+			mesh_indices[i] = remap[mesh_indices[i]];
+}
+
+/** \brief merges byte-identical textile32 pages.
+  *
+  * object_textures and sprite_textures get remapped to the first page of each group and
+  * num_textiles, num_room_textiles and num_obj_textiles count the pages that are left. The
+  * bump and misc textiles at the end are kept as they are, they are addressed by their position.
+  */
+void VT_Level::dedup_textiles()
+{
+	std::multimap < bitu32, bitu32 > canonical;	// hash -> index of the first page with that contents
+	std::multimap < bitu32, bitu32 >::iterator it;
+	std::vector < bitu32 > remap(textile32.size());
+	std::vector < bitu32 > kept;
+	bitu32 num_fixed = num_bump_textiles + num_misc_textiles;
+	bitu32 num_pages;
+	bitu32 num_room = 0, num_obj = 0;	// pages of each range that are kept
+	bitu32 i;
+
+	dedup_report.textiles_before = textile32.size();
+	num_pages = (textile32.size() > num_fixed) ? (textile32.size() - num_fixed) : 0;
+
+	for (i = 0; i < textile32.size(); i++) {
+		bitu32 hash;
+
+		if (i >= num_pages) {
+			remap[i] = kept.size();
+			kept.push_back(i);
+			continue;
+		}
+
+		hash = hash_data(textile32[i].pixels, sizeof(textile32[i].pixels));
+		for (it = canonical.lower_bound(hash); (it != canonical.end()) && (it->first == hash); ++it)
+			if (!memcmp(textile32[it->second].pixels, textile32[i].pixels, sizeof(textile32[i].pixels)))
+				break;
+
+		if ((it != canonical.end()) && (it->first == hash)) {
+			remap[i] = remap[it->second];
+			dedup_report.bytes_saved += sizeof(tr4_textile32_t);
+			continue;
+		}
+
+		canonical.insert(std::make_pair(hash, i));
+		remap[i] = kept.size();
+		kept.push_back(i);
+		if (i < num_room_textiles)
+			num_room++;
+		else if (i < num_room_textiles + num_obj_textiles)
+			num_obj++;
+	}
+
+	dedup_report.textiles_after = kept.size();
+	if (kept.size() == textile32.size())
+		return;
+
+	tr4_textile32_array_t new_textile32(kept.size());
+
+	for (i = 0; i < kept.size(); i++)
+		new_textile32[i] = textile32[kept[i]];
+	textile32.swap(new_textile32);
+	num_textiles -= remap.size() - kept.size();
+	// the kept pages stay in order, so the room pages still come before the object pages
+	num_room_textiles = num_room;
+	num_obj_textiles = num_obj;
+
+	for (i = 0; i < object_textures.size(); i++)
+		if (object_textures[i].tile < remap.size())
+			object_textures[i].tile = remap[object_textures[i].tile];
+	for (i = 0; i < sprite_textures.size(); i++)
+		if (sprite_textures[i].tile < remap.size())
+			sprite_textures[i].tile = remap[sprite_textures[i].tile];
+}
+
+/** \brief resolves the texture coordinates of all object textures.
+  *
+  * The coordinates are relative to the textile, or to the atlas page if the atlas was built.
+  * Object textures on a textile that does not exist get VT_BATCH_COLOURED, their faces are
+  * drawn untextured.
+  */
+void VT_Level::build_object_texture_uvs()
+{
+	bitu32 i, j;
+
+	object_texture_uvs.resize(object_textures.size());
+	for (i = 0; i < object_textures.size(); i++) {
+		tr4_object_texture_t & src = object_textures[i];
+		vt_object_texture_uv_t & dst = object_texture_uvs[i];
+		float x = 0.0f, y = 0.0f, scale = 1.0f / 256.0f;
+
+		dst.tile = (src.tile < textile32.size()) ? src.tile : VT_BATCH_COLOURED;
+		if (!atlas.pages.empty()) {
+			vt_atlas_tile_t & tile = atlas.tiles[(src.tile < atlas.tiles.size()) ? src.tile : 0];
+
+			dst.tile = tile.page;
+			x = tile.x;
+			y = tile.y;
+			scale = 1.0f / (float)atlas.page_size;
+		}
+
+		for (j = 0; j < 4; j++) {
+			tr4_object_texture_vert_t & vert = src.vertices[j];
+
+			dst.uv[j][0] = (x + (float)vert.xpixel + (float)vert.xcoordinate * 0.5f) * scale;
+			dst.uv[j][1] = (y + (float)vert.ypixel + (float)vert.ycoordinate * 0.5f) * scale;
+		}
+	}
+}
+
+/** \brief finds the room and sector containing pos.
+  *
+  * Returns false if pos is not inside any room. Only valid after prepare_level().
+  */
+bool VT_Level::locate(const vec3_t & pos, vt_location_t & loc)
+{
+	return vt_locate(rooms, room_grid, pos, loc);
+}
+
+/// \brief face waiting to be sorted into its batch.
+typedef struct {
+	bitu16 tile;		///< \brief batch of the face.
+	bitu16 num_corners;	///< \brief 3 or 4.
+	bitu32 first_corner;	///< \brief index of the first corner in the corner list.
+} batch_face_t;
+
+static bool batch_face_less(const batch_face_t & a, const batch_face_t & b)
+{
+	return a.tile < b.tile;
+}
+
+/** \brief sorts the faces by tile and fills dst.
+  *
+  * corners holds num_corners vertices for each face. Rectangles are split into two triangles.
+  */
+static void finish_batches(std::vector < batch_face_t > &faces, std::vector < vt_batch_vertex_t > &corners, vt_batched_mesh_t & dst)
+{
+	bitu32 num_indices = 0;
+	bitu32 num_batches = 0;
+	bitu32 i, j;
+
+	std::stable_sort(faces.begin(), faces.end(), batch_face_less);
+	for (i = 0; i < faces.size(); i++) {
+		num_indices += (faces[i].num_corners == 4) ? 6 : 3;
+		if ((i == 0) || (faces[i].tile != faces[i - 1].tile))
+			num_batches++;
+	}
+
+	dst.vertices.resize(0);
+	dst.vertices.resize(corners.size());
+	dst.indices.resize(0);
+	dst.indices.resize(num_indices);
+	dst.batches.resize(0);
+	dst.batches.resize(num_batches);
+
+	bitu32 vertex = 0;
+	bitu32 index = 0;
+	vt_batch_t *batch = NULL;
+
+	for (i = 0; i < faces.size(); i++) {
+		batch_face_t & face = faces[i];
+
+		if ((batch == NULL) || (face.tile != batch->tile)) {
+			batch = (batch == NULL) ? &dst.batches[0] : batch + 1;
+			batch->tile = face.tile;
+			batch->first_index = index;
+			batch->num_indices = 0;
+			batch->min_vertex = vertex;
+		}
+		for (j = 0; j < face.num_corners; j++)
+			dst.vertices[vertex + j] = corners[face.first_corner + j];
+		dst.indices[index++] = vertex;
+		dst.indices[index++] = vertex + 1;
+		dst.indices[index++] = vertex + 2;
+		if (face.num_corners == 4) {
+			dst.indices[index++] = vertex;
+			dst.indices[index++] = vertex + 2;
+			dst.indices[index++] = vertex + 3;
+		}
+		vertex += face.num_corners;
+		batch->num_indices = index - batch->first_index;
+		batch->max_vertex = vertex - 1;
+	}
+}
+
+/** \brief builds the batched geometry of all rooms and meshes.
+  *
+  * Has to be called again if the object texture coordinates get rebuilt, as the batches depend
+  * on the tiles.
+  */
+void VT_Level::build_batches()
+{
+	bitu32 i;
+
+	room_batches.resize(rooms.size());
+	for (i = 0; i < rooms.size(); i++)
+		build_room_batches(i, room_batches[i]);
+	mesh_batches.resize(meshes.size());
+	for (i = 0; i < meshes.size(); i++)
+		build_mesh_batches(meshes[i], mesh_batches[i]);
+}
+
+/** \brief builds the batched geometry of a room.
+  *
+  * The positions are relative to the room offset, like the room vertices. The vertex colours get
+  * full alpha, as the viewer always drew rooms with qglColor3ubv. Faces with invalid vertex or
+  * object texture indices are left out.
+  */
+void VT_Level::build_room_batches(bitu32 room_num, vt_batched_mesh_t & dst)
+{
+	tr5_room_t & room = rooms[room_num];
+	vt_room_vertices_t & verts = room_vertices[room_num];
+	vt_vec4_array_t scratch;
+	const vt_vec4_t *positions = get_room_positions(room_num, scratch);
+	std::vector < batch_face_t > faces;
+	std::vector < vt_batch_vertex_t > corners;
+	bitu32 i, j;
+
+	faces.reserve(room.num_rectangles + room.num_triangles);
+	corners.reserve(room.num_rectangles * 4 + room.num_triangles * 3);
+	for (i = 0; i < room.num_rectangles + room.num_triangles; i++) {
+		bool rectangle = (i < room.num_rectangles);
+		bitu16 *v = rectangle ? room.rectangles[i].vertices : room.triangles[i - room.num_rectangles].vertices;
+		bitu16 texture = (rectangle ? room.rectangles[i].texture : room.triangles[i - room.num_rectangles].texture) & 0x0fff;
+		batch_face_t face;
+
+		face.num_corners = rectangle ? 4 : 3;
+		face.first_corner = corners.size();
+		if (texture >= object_texture_uvs.size())
+			continue;
+		for (j = 0; j < face.num_corners; j++)
+			if (v[j] >= verts.num_vertices)
+				break;
+		if (j < face.num_corners)
+			continue;
+
+		vt_object_texture_uv_t & tex = object_texture_uvs[texture];
+
+		face.tile = tex.tile;
+		for (j = 0; j < face.num_corners; j++) {
+			vt_batch_vertex_t corner;
+
+			corner.position[0] = positions[v[j]].x;
+			corner.position[1] = positions[v[j]].y;
+			corner.position[2] = positions[v[j]].z;
+			corner.uv[0] = tex.uv[j][0];
+			corner.uv[1] = tex.uv[j][1];
+			corner.colour = verts.colours[v[j]];
+			corner.colour.a = 255;
+			corners.push_back(corner);
+		}
+		faces.push_back(face);
+	}
+
+	finish_batches(faces, corners, dst);
+}
+
+/** \brief builds the batched geometry of a mesh.
+  *
+  * The textured faces get white vertex colours, the viewer draws them with the intensity of
+  * the instance. The coloured faces get their palette colour and end up in the
+  * VT_BATCH_COLOURED batch. Faces with invalid vertex or object texture indices are left out.
+  */
+void VT_Level::build_mesh_batches(tr4_mesh_t & mesh, vt_batched_mesh_t & dst)
+{
+	bitu32 num_textured = mesh.num_textured_rectangles + mesh.num_textured_triangles;
+	bitu32 num_faces = num_textured + mesh.num_coloured_rectangles + mesh.num_coloured_triangles;
+	std::vector < batch_face_t > faces;
+	std::vector < vt_batch_vertex_t > corners;
+	bitu32 i, j;
+
+	if (mesh.num_vertices <= 0)
+		num_faces = 0;
+	faces.reserve(num_faces);
+	corners.reserve(num_faces * 4);
+	for (i = 0; i < num_faces; i++) {
+		bitu16 *v;
+		bitu16 texture;
+		batch_face_t face;
+
+		// textured rectangles, textured triangles, coloured rectangles, coloured triangles
+		if (i < (bitu32)mesh.num_textured_rectangles) {
+			tr4_face4_t & f = mesh_rectangles[mesh.textured_rectangle_offset + i];
+
+			v = f.vertices;
+			texture = f.texture;
+			face.num_corners = 4;
+		} else if (i < num_textured) {
+			tr4_face3_t & f = mesh_triangles[mesh.textured_triangle_offset + i - mesh.num_textured_rectangles];
+
+			v = f.vertices;
+			texture = f.texture;
+			face.num_corners = 3;
+		} else if (i < num_textured + mesh.num_coloured_rectangles) {
+			tr4_face4_t & f = mesh_rectangles[mesh.coloured_rectangle_offset + i - num_textured];
+
+			v = f.vertices;
+			texture = f.texture;
+			face.num_corners = 4;
+		} else {
+			tr4_face3_t & f = mesh_triangles[mesh.coloured_triangle_offset + i - num_textured - mesh.num_coloured_rectangles];
+
+			v = f.vertices;
+			texture = f.texture;
+			face.num_corners = 3;
+		}
+		face.first_corner = corners.size();
+
+		for (j = 0; j < face.num_corners; j++)
+			if (v[j] >= (bitu32)mesh.num_vertices)
+				break;
+		if (j < face.num_corners)
+			continue;
+
+		vt_batch_vertex_t corner;
+
+		if (i < num_textured) {
+			if ((texture & 0x0fff) >= object_texture_uvs.size())
+				continue;
+
+			vt_object_texture_uv_t & tex = object_texture_uvs[texture & 0x0fff];
+
+			face.tile = tex.tile;
+			corner.colour.r = corner.colour.g = corner.colour.b = corner.colour.a = 255;
+			for (j = 0; j < face.num_corners; j++) {
+				tr5_vertex_t & p = mesh_vertices[mesh.vertex_offset + v[j]];
+
+				corner.position[0] = p.x;
+				corner.position[1] = p.y;
+				corner.position[2] = p.z;
+				corner.uv[0] = tex.uv[j][0];
+				corner.uv[1] = tex.uv[j][1];
+				corners.push_back(corner);
+			}
+		} else {
+			face.tile = VT_BATCH_COLOURED;
+			corner.colour = palette.colour[texture & 0xff];
+			corner.colour.a = 255;
+			corner.uv[0] = corner.uv[1] = 0.0f;
+			for (j = 0; j < face.num_corners; j++) {
+				tr5_vertex_t & p = mesh_vertices[mesh.vertex_offset + v[j]];
+
+				corner.position[0] = p.x;
+				corner.position[1] = p.y;
+				corner.position[2] = p.z;
+				corners.push_back(corner);
+			}
+		}
+		faces.push_back(face);
+	}
+
+	finish_batches(faces, corners, dst);
+}
+
+/** \brief groups the items by room.
+  *
+  * The items of room i are items[room_items[room_item_start[i]]] up to (excluding)
+  * items[room_items[room_item_start[i + 1]]], in their original order. Items with an invalid
+  * room are left out.
+  */
+void VT_Level::build_room_items()
+{
+	bitu32 i;
+
+	room_item_start.resize(0);
+	room_item_start.resize(rooms.size() + 1, 0);
+	for (i = 0; i < items.size(); i++) {
+		bit32 room = items[i].room;
+
+		if ((room >= 0) && ((bitu32)room < rooms.size()))
+			room_item_start[room + 1]++;
+	}
+	for (i = 0; i < rooms.size(); i++)
+		room_item_start[i + 1] += room_item_start[i];
+
+	bitu32_array_t fill;
+
+	fill.copy(room_item_start);
+	room_items.resize(0);
+	room_items.resize(room_item_start[rooms.size()]);
+	for (i = 0; i < items.size(); i++) {
+		bit32 room = items[i].room;
+
+		if ((room >= 0) && ((bitu32)room < rooms.size()))
+			room_items[fill[room]++] = i;
+	}
+}
+
+/** \brief calculates the bounds of every moveable.
+  *
+  * The meshes are placed by the mesh tree alone, without animation, the same way draw_item in
+  * the viewer does it. The boxes are relative to the item position before its rotation.
+  */
+void VT_Level::build_moveable_boxes()
+{
+	std::vector < vec3_t > stack;
+	bitu32 i, j, k;
+
+	moveable_boxes.resize(moveables.size());
+	for (i = 0; i < moveables.size(); i++) {
+		tr_moveable_t & moveable = moveables[i];
+		vt_box_t & box = moveable_boxes[i];
+		vec3_t offset;
+
+		box.min = vec3_t(FLT_MAX, FLT_MAX, FLT_MAX);
+		box.max = vec3_t(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		stack.clear();
+		stack.push_back(offset);
+		for (j = 0; j < moveable.num_meshes; j++) {
+			bitu32 mesh_index = moveable.starting_mesh + j;
+
+			if ((mesh_index < mesh_indices.size()) && (mesh_indices[mesh_index] < meshes.size())) {
+				tr4_mesh_t & mesh = meshes[mesh_indices[mesh_index]];
+				bitu32 num_vertices = (mesh.num_vertices > 0) ? mesh.num_vertices : 0;
+
+				for (k = 0; k < num_vertices; k++) {
+					tr5_vertex_t & v = mesh_vertices[mesh.vertex_offset + k];
+
+					box.min.x = std::min(box.min.x, v.x + offset.x);
+					box.min.y = std::min(box.min.y, v.y + offset.y);
+					box.min.z = std::min(box.min.z, v.z + offset.z);
+					box.max.x = std::max(box.max.x, v.x + offset.x);
+					box.max.y = std::max(box.max.y, v.y + offset.y);
+					box.max.z = std::max(box.max.z, v.z + offset.z);
+				}
+			}
+
+			if (moveable.mesh_tree_index + j >= mesh_trees.size())
+				continue;
+
+			tr_meshtree_t & node = mesh_trees[moveable.mesh_tree_index + j];
+
+			if (node.flags & 1) {
+				offset = stack.empty() ? vec3_t() : stack.back();
+				if (!stack.empty())
+					stack.pop_back();
+			}
+			if (node.flags & 2)
+				stack.push_back(offset);
+			offset += vec3_t(node.offset.x, node.offset.y, node.offset.z);
+		}
+	}
+}
+
+/// \brief appends a world space triangle to the BVH input.
+static void add_bvh_triangle(std::vector < vt_bvh_triangle_t > &triangles, const vec3_t & a, const vec3_t & b, const vec3_t & c, bitu32 room, bitu32 static_mesh)
+{
+	vt_bvh_triangle_t tri;
+
+	tri.v0[0] = a.x;
+	tri.v0[1] = a.y;
+	tri.v0[2] = a.z;
+	tri.e1[0] = b.x - a.x;
+	tri.e1[1] = b.y - a.y;
+	tri.e1[2] = b.z - a.z;
+	tri.e2[0] = c.x - a.x;
+	tri.e2[1] = c.y - a.y;
+	tri.e2[2] = c.z - a.z;
+	tri.room = room;
+	tri.static_mesh = static_mesh;
+	triangles.push_back(tri);
+}
+
+/** \brief builds bvh from the room geometry and the room static meshes.
+  *
+  * Rectangles are split into two triangles. Static meshes are placed the way the viewer draws
+  * them (translated to pos and rotated around y). Faces with invalid vertex indices are left out.
+  */
+void VT_Level::build_bvh()
+{
+	std::vector < vt_bvh_triangle_t > triangles;
+	vt_vec4_array_t scratch;
+	bitu32 i, j, k;
+
+	for (i = 0; i < rooms.size(); i++) {
+		tr5_room_t & room = rooms[i];
+		bitu32 num_vertices = room_vertices[i].num_vertices;
+		const vt_vec4_t *positions = get_room_positions(i, scratch);
+		std::vector < vec3_t > world(num_vertices);
+
+		for (j = 0; j < num_vertices; j++)
+			world[j] = vec3_t(positions[j].x + room.offset.x, positions[j].y, positions[j].z + room.offset.z);
+
+		for (j = 0; j < room.num_rectangles; j++) {
+			bitu16 *v = room.rectangles[j].vertices;
+
+			if ((v[0] >= num_vertices) || (v[1] >= num_vertices) || (v[2] >= num_vertices) || (v[3] >= num_vertices))
+				continue;
+			add_bvh_triangle(triangles, world[v[0]], world[v[1]], world[v[2]], i, VT_BVH_NONE);
+			add_bvh_triangle(triangles, world[v[0]], world[v[2]], world[v[3]], i, VT_BVH_NONE);
+		}
+		for (j = 0; j < room.num_triangles; j++) {
+			bitu16 *v = room.triangles[j].vertices;
+
+			if ((v[0] >= num_vertices) || (v[1] >= num_vertices) || (v[2] >= num_vertices))
+				continue;
+			add_bvh_triangle(triangles, world[v[0]], world[v[1]], world[v[2]], i, VT_BVH_NONE);
+		}
+
+		for (j = 0; j < room.num_static_meshes; j++) {
+			tr2_room_staticmesh_t & instance = room.static_meshes[j];
+			tr_staticmesh_t *sm = find_staticmesh_id(instance.object_id);
+
+			if ((sm == NULL) || (sm->mesh >= mesh_indices.size()) || (mesh_indices[sm->mesh] >= meshes.size()))
+				continue;
+
+			tr4_mesh_t & mesh = meshes[mesh_indices[sm->mesh]];
+			float angle = instance.rotation * (float)M_PI / 180.0f;
+			float c = cos(angle);
+			float s = sin(angle);
+
+			if (mesh.num_vertices <= 0)
+				continue;
+			// same as qglTranslatef(pos) followed by qglRotatef(rotation, 0, 1, 0)
+			world.resize(mesh.num_vertices);
+			for (k = 0; k < (bitu32)mesh.num_vertices; k++) {
+				tr5_vertex_t & p = mesh_vertices[mesh.vertex_offset + k];
+
+				world[k] = vec3_t(instance.pos.x + c * p.x + s * p.z, instance.pos.y + p.y, instance.pos.z - s * p.x + c * p.z);
+			}
+
+			// the coloured faces follow the textured ones
+			bitu32 num_rectangles = mesh.num_textured_rectangles + mesh.num_coloured_rectangles;
+			bitu32 num_triangles = mesh.num_textured_triangles + mesh.num_coloured_triangles;
+
+			for (k = 0; k < num_rectangles; k++) {
+				bitu16 *v = mesh_rectangles[mesh.textured_rectangle_offset + k].vertices;
+
+				if ((v[0] >= world.size()) || (v[1] >= world.size()) || (v[2] >= world.size()) || (v[3] >= world.size()))
+					continue;
+				add_bvh_triangle(triangles, world[v[0]], world[v[1]], world[v[2]], i, j);
+				add_bvh_triangle(triangles, world[v[0]], world[v[2]], world[v[3]], i, j);
+			}
+			for (k = 0; k < num_triangles; k++) {
+				bitu16 *v = mesh_triangles[mesh.textured_triangle_offset + k].vertices;
+
+				if ((v[0] >= world.size()) || (v[1] >= world.size()) || (v[2] >= world.size()))
+					continue;
+				add_bvh_triangle(triangles, world[v[0]], world[v[1]], world[v[2]], i, j);
+			}
+		}
+	}
+
+	bvh.triangles.resize(0);
+	bvh.triangles.resize(triangles.size());
+	for (i = 0; i < triangles.size(); i++)
+		bvh.triangles[i] = triangles[i];
+	vt_build_bvh(bvh);
+}
+
+#define ID_LOOKUP_NONE 0xffffffff	///< \brief unused entry in an id lookup table.
+#define ID_LOOKUP_MAX 65536	///< \brief ids from here on are not put into the lookup tables.
+
+/** \brief builds a dense object_id -> index table.
+  *
+  * The first element with an id wins, like with a linear search. Negative ids and ids of
+  * ID_LOOKUP_MAX and above are left out.
+  */
+template < class T > static void build_id_lookup(prtl::array < T > &elements, bitu32_array_t & lookup)
+{
+	bitu32 size = 0;
+	bitu32 i;
+
+	for (i = 0; i < elements.size(); i++) {
+		bit32 id = (bit32)elements[i].object_id;
+
+		if ((id >= 0) && (id < ID_LOOKUP_MAX) && ((bitu32)id >= size))
+			size = id + 1;
+	}
+
+	lookup.resize(0);
+	lookup.resize(size, ID_LOOKUP_NONE);
+	for (i = 0; i < elements.size(); i++) {
+		bit32 id = (bit32)elements[i].object_id;
+
+		if ((id >= 0) && (id < ID_LOOKUP_MAX) && (lookup[id] == ID_LOOKUP_NONE))
+			lookup[id] = i;
+	}
+}
+
+/** \brief finds the first element with the given object_id.
+  *
+  * Uses the lookup table if the id is covered by it, otherwise (table not built yet or id out
+  * of its range) falls back to a linear search.
+  */
+template < class T > static T *find_id(prtl::array < T > &elements, bitu32_array_t & lookup, bit32 object_id)
+{
+	bitu32 i;
+
+	if ((object_id >= 0) && ((bitu32)object_id < lookup.size())) {
+		i = lookup[object_id];
+		return (i == ID_LOOKUP_NONE) ? NULL : &elements[i];
+	}
+	if (!lookup.empty() && (object_id >= 0) && (object_id < ID_LOOKUP_MAX))
+		return NULL;
+
+	for (i = 0; i < elements.size(); i++)
+		if ((bit32)elements[i].object_id == object_id)
+			return &elements[i];
 
 	return NULL;
 }
 
+/** \brief builds the lookup tables used by the find_*_id functions.
+  *
+  * This includes the moveables of Lara, which draw_item looks up by their fixed ids.
+  */
+void VT_Level::build_id_lookups()
+{
+	build_id_lookup(static_meshes, staticmesh_lookup);
+	build_id_lookup(moveables, moveable_lookup);
+	build_id_lookup(items, item_lookup);
+}
+
+tr_staticmesh_t *VT_Level::find_staticmesh_id(bitu32 object_id)
+{
+	return find_id(static_meshes, staticmesh_lookup, (bit32)object_id);
+}
+
+tr2_item_t *VT_Level::find_item_id(bit32 object_id)
+{
+	return find_id(items, item_lookup, object_id);
+}
+
+tr_moveable_t *VT_Level::find_moveable_id(bitu32 object_id)
+{
+	return find_id(moveables, moveable_lookup, (bit32)object_id);
+}
+
 void VT_Level::convert_textile8_to_textile32(tr_textile8_t & tex, tr2_palette_t & pal, tr4_textile32_t & dst)
 {
 	int x, y;
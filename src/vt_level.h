@@ -2,18 +2,151 @@
 #define _VT_LEVEL_H_
 
 #include "l_main.h"
+#include "vt_simd.h"
+#include "vt_atlas.h"
+#include "vt_rooms.h"
+#include "vt_bvh.h"
+
+/** \brief Room vertices as separate streams (structure of arrays).
+  *
+  * Built from tr5_room_t::vertices by VT_Level::prepare_level. Only the data the renderer and
+  * the culling code need is kept, every stream has num_vertices entries and can be handed
+  * directly to qglVertexPointer (3 floats, stride 16), qglColorPointer (4 unsigned bytes) and SIMD kernels.
+  *
+  * In compact geometry mode the positions are kept as 16-bit integers relative to origin
+  * (positions16) and positions is empty; VT_Level::get_room_positions expands them on demand.
+  * tr5_room_t::vertices gets freed once the streams are built, they are the only copy.
+  * Empty normal streams mean all normals are zero (TR1-TR4).
+  *
+  * The streams are a load time form: the renderers draw from VT_Level::room_batches, and
+  * VT_Level::free_room_streams drops the streams once the batches are final, keeping only the
+  * counts and bounds. Compact geometry therefore only lowers the memory peak while loading.
+  */
+typedef struct {
+	bitu32 num_vertices;	///< \brief number of vertices in each stream.
+	vt_vec4_array_t positions;	///< \brief x, y, z relative to tr5_room_t::offset x/z, w is 1.
+	vt_vec4_16_array_t positions16;	///< \brief compact positions, add origin to get positions.
+	vt_vec4_t origin;	///< \brief offset of positions16.
+	tr2_colour_array_t colours;	///< \brief vertex colours as RGBA8.
+	vt_normal8_array_t normals;	///< \brief vertex normals (TR5 only, zero otherwise).
+	vt_vec4_t bbox_min;	///< \brief lower corner of the bounding box of positions.
+	vt_vec4_t bbox_max;	///< \brief upper corner of the bounding box of positions.
+} vt_room_vertices_t;
+typedef prtl::array < vt_room_vertices_t > vt_room_vertices_array_t;
+
+/** \brief Object texture with resolved texture coordinates.
+  *
+  * Built for every object texture by VT_Level::prepare_level, so the renderers do not need to
+  * decode tr4_object_texture_vert_t for every vertex.
+  */
+typedef struct {
+	bitu16 tile;		///< \brief textile index, or atlas page if the atlas is used, VT_BATCH_COLOURED for a missing textile.
+	float uv[4][2];		///< \brief u and v of the four corners, same order as tr4_object_texture_t::vertices.
+} vt_object_texture_uv_t;
+typedef prtl::array < vt_object_texture_uv_t > vt_object_texture_uv_array_t;
+
+#define VT_BATCH_COLOURED 0xffff	///< \brief vt_batch_t::tile of untextured faces.
+
+/// \brief Vertex of the batched geometry, 24 bytes.
+typedef struct {
+	float position[3];	///< \brief same space as the source vertices.
+	float uv[2];		///< \brief texture coordinates, 0 for untextured faces.
+	tr2_colour_t colour;	///< \brief RGBA8 vertex colour.
+} vt_batch_vertex_t;
+typedef prtl::array < vt_batch_vertex_t > vt_batch_vertex_array_t;
+
+/** \brief Faces of one texture, drawn with a single qglDrawRangeElements.
+  *
+  * The triangles are indices[first_index] up to (excluding) indices[first_index + num_indices],
+  * they only use vertices min_vertex to max_vertex.
+  */
+typedef struct {
+	bitu16 tile;		///< \brief like vt_object_texture_uv_t::tile, VT_BATCH_COLOURED for untextured faces.
+	bitu32 first_index;	///< \brief first index of the batch.
+	bitu32 num_indices;	///< \brief number of indices, a multiple of 3.
+	bitu32 min_vertex;	///< \brief lowest vertex used.
+	bitu32 max_vertex;	///< \brief highest vertex used.
+} vt_batch_t;
+typedef prtl::array < vt_batch_t > vt_batch_array_t;
+
+/** \brief Geometry as triangle lists sorted by texture.
+  *
+  * Every face corner has its own vertex, as the texture coordinates belong to the faces. The
+  * batches are sorted by tile, untextured faces come last.
+  */
+typedef struct {
+	vt_batch_vertex_array_t vertices;	///< \brief vertices of all batches.
+	bitu32_array_t indices;	///< \brief triangle indices of all batches.
+	vt_batch_array_t batches;	///< \brief one per tile.
+} vt_batched_mesh_t;
+typedef prtl::array < vt_batched_mesh_t > vt_batched_mesh_array_t;
+
+/// \brief Axis aligned box, min is larger than max if it is empty.
+typedef struct {
+	vec3_t min;		///< \brief lower corner.
+	vec3_t max;		///< \brief upper corner.
+} vt_box_t;
+typedef prtl::array < vt_box_t > vt_box_array_t;
+
+/// \brief Result of the duplicate removal done by VT_Level::prepare_level.
+typedef struct {
+	bitu32 meshes_before;	///< \brief number of meshes as read.
+	bitu32 meshes_after;	///< \brief number of distinct meshes.
+	bitu32 textiles_before;	///< \brief number of textile32 pages as read.
+	bitu32 textiles_after;	///< \brief number of distinct textile32 pages.
+	bitu32 bytes_saved;	///< \brief memory freed by merging duplicates.
+} vt_dedup_report_t;
 
 class VT_Level : public TR_Level {
       public:
+	bool compact_geometry;	///< \brief keep room positions as 16-bit integers, set before prepare_level().
+	vt_room_vertices_array_t room_vertices;	///< \brief vertex streams for each room, same index as rooms.
+	vt_dedup_report_t dedup_report;	///< \brief what prepare_level() merged.
+	bitu32 atlas_page_size;	///< \brief maximum atlas page size, set before prepare_level(), 0 disables the atlas.
+	vt_atlas_t atlas;	///< \brief textile32 packed into atlas pages.
+	vt_object_texture_uv_array_t object_texture_uvs;	///< \brief same index as object_textures.
+	vt_room_grid_t room_grid;	///< \brief spatial index of the rooms for locate().
+	vt_room_graph_t room_graph;	///< \brief portal and alternate room adjacency of the rooms.
+	vt_batched_mesh_array_t room_batches;	///< \brief batched room geometry, same index as rooms.
+	vt_batched_mesh_array_t mesh_batches;	///< \brief batched mesh geometry, same index as meshes.
+	bitu32_array_t room_item_start;	///< \brief rooms.size() + 1 offsets into room_items.
+	bitu32_array_t room_items;	///< \brief indices into items, grouped by tr2_item_t::room.
+	vt_box_array_t moveable_boxes;	///< \brief bounds of each moveable as the viewer draws it, same index as moveables.
+	vt_bvh_t bvh;		///< \brief world space room and room static mesh triangles for ray queries.
+
+	VT_Level();
 	void prepare_level();
+	const vt_vec4_t *get_room_positions(bitu32 room, vt_vec4_array_t & scratch);
+	bitu32 get_room_vertices_size();
+	void free_room_streams();
+	void build_object_texture_uvs();
+	void build_batches();
+	bool locate(const vec3_t & pos, vt_location_t & loc);
 	void dump_textures();
 	tr_staticmesh_t *find_staticmesh_id(bitu32 object_id);
 	tr2_item_t *find_item_id(bit32 object_id);
 	tr_moveable_t *find_moveable_id(bitu32 object_id);
 
       protected:
+	bitu32_array_t staticmesh_lookup;	///< \brief object_id -> index into static_meshes.
+	bitu32_array_t moveable_lookup;	///< \brief object_id -> index into moveables.
+	bitu32_array_t item_lookup;	///< \brief object_id -> index of the first item in items.
+
 	void convert_textile8_to_textile32(tr_textile8_t & tex, tr2_palette_t & pal, tr4_textile32_t & dst);
 	void convert_textile16_to_textile32(tr2_textile16_t & tex, tr4_textile32_t & dst);
+	void build_room_vertices(tr5_room_t & room, vt_room_vertices_t & dst);
+	bool compact_room_vertices(vt_room_vertices_t & dst);
+	bitu32 hash_mesh(tr4_mesh_t & mesh);
+	bool compare_meshes(tr4_mesh_t & a, tr4_mesh_t & b);
+	bitu32 get_mesh_size(tr4_mesh_t & mesh);
+	void dedup_meshes();
+	void dedup_textiles();
+	void build_id_lookups();
+	void build_bvh();
+	void build_room_items();
+	void build_moveable_boxes();
+	void build_room_batches(bitu32 room_num, vt_batched_mesh_t & dst);
+	void build_mesh_batches(tr4_mesh_t & mesh, vt_batched_mesh_t & dst);
 };
 
-#endif // _VT_LEVEL_H_
\ No newline at end of file
+#endif // _VT_LEVEL_H_
@@ -0,0 +1,554 @@
+/*
+ * Copyright 2002 - Florian Schulze <crow@icculus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * This file is part of vt.
+ *
+ */
+
+
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#ifdef _WIN32
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+#else
+# include <unistd.h>
+#endif
+#include "SDL.h"
+#include "SDL_thread.h"
+#include "vt_raster.h"
+
+#define RCSID "$Id$"
+
+/// \brief Vertex during clipping, clip space position and attributes.
+typedef struct {
+	float pos[4];		///< \brief x, y, z, w.
+	float uv[2];		///< \brief texture coordinates.
+	float colour[4];	///< \brief r, g, b, a in 0..1.
+} raster_vertex_t;
+
+static int raster_worker(void *data);
+
+/** \brief creates the buffers and the worker threads.
+  *
+  * num_threads is the number of threads shading tiles, including the one calling
+  * vt_raster_flush.
+  */
+void vt_raster_init(vt_raster_t & r, bit32 width, bit32 height, bit32 num_threads)
+{
+	bit32 i;
+
+	r.width = width;
+	r.height = height;
+	r.tiles_x = (width + VT_RASTER_TILE_SIZE - 1) / VT_RASTER_TILE_SIZE;
+	r.tiles_y = (height + VT_RASTER_TILE_SIZE - 1) / VT_RASTER_TILE_SIZE;
+	r.colour.resize(width * height);
+	r.depth.resize(width * height);
+	r.num_triangles = 0;
+	r.bins.resize(r.tiles_x * r.tiles_y);
+	r.bin_sizes.resize(r.tiles_x * r.tiles_y, 0);
+
+	if (num_threads < 1)
+		num_threads = 1;
+	if (num_threads > VT_RASTER_MAX_THREADS)
+		num_threads = VT_RASTER_MAX_THREADS;
+	r.quit = false;
+	r.next_tile = 0;
+	r.start = SDL_CreateSemaphore(0);
+	r.done = SDL_CreateSemaphore(0);
+	r.lock = SDL_CreateMutex();
+	r.num_threads = 1;
+	for (i = 1; i < num_threads; i++) {
+		if ((r.threads[r.num_threads - 1] = SDL_CreateThread(raster_worker, &r)) == NULL)
+			break;
+		r.num_threads++;
+	}
+}
+
+/// \brief stops the worker threads and frees the buffers.
+void vt_raster_free(vt_raster_t & r)
+{
+	bit32 i;
+
+	r.quit = true;
+	for (i = 0; i < r.num_threads - 1; i++)
+		SDL_SemPost(r.start);
+	for (i = 0; i < r.num_threads - 1; i++)
+		SDL_WaitThread(r.threads[i], NULL);
+	r.num_threads = 1;
+	SDL_DestroySemaphore(r.start);
+	SDL_DestroySemaphore(r.done);
+	SDL_DestroyMutex(r.lock);
+
+	r.colour.resize(0);
+	r.depth.resize(0);
+	r.triangles.resize(0);
+	r.bins.resize(0);
+	r.bin_sizes.resize(0);
+	r.clip.resize(0);
+}
+
+/// \brief fills the colour buffer with colour and the depth buffer with the far plane.
+void vt_raster_clear(vt_raster_t & r, tr2_colour_t colour)
+{
+	bitu32 pixel;
+	bitu32 i;
+
+	memcpy(&pixel, &colour, sizeof(pixel));
+	for (i = 0; i < r.colour.size(); i++) {
+		r.colour[i] = pixel;
+		r.depth[i] = 1.0f;
+	}
+}
+
+/// \brief returns the point between a and b where the near plane distance z + w is 0.
+static void clip_near(const raster_vertex_t & a, const raster_vertex_t & b, raster_vertex_t & out)
+{
+	float da = a.pos[2] + a.pos[3];
+	float db = b.pos[2] + b.pos[3];
+	float t = da / (da - db);
+	int i;
+
+	for (i = 0; i < 4; i++)
+		out.pos[i] = a.pos[i] + (b.pos[i] - a.pos[i]) * t;
+	for (i = 0; i < 2; i++)
+		out.uv[i] = a.uv[i] + (b.uv[i] - a.uv[i]) * t;
+	for (i = 0; i < 4; i++)
+		out.colour[i] = a.colour[i] + (b.colour[i] - a.colour[i]) * t;
+}
+
+/** \brief sets up a triangle in front of the near plane and adds it to the bins of its tiles.
+  *
+  * Back faces (front faces in OpenGL terms, see glCullFace(GL_FRONT)) and triangles without
+  * pixels are dropped.
+  */
+static void setup_triangle(vt_raster_t & r, const raster_vertex_t *v[3], const bitu32 *texture, bitu32 texture_size)
+{
+	float x[3], y[3], values[VT_RASTER_NUM_PLANES][3];
+	float area, min_x, min_y, max_x, max_y;
+	bit32 tx, ty, tx0, ty0, tx1, ty1;
+	int i, k;
+
+	for (i = 0; i < 3; i++) {
+		float iw = 1.0f / v[i]->pos[3];
+
+		x[i] = (v[i]->pos[0] * iw * 0.5f + 0.5f) * r.width;
+		y[i] = (0.5f - v[i]->pos[1] * iw * 0.5f) * r.height;
+		values[0][i] = v[i]->pos[2] * iw;
+		values[1][i] = iw;
+		values[2][i] = v[i]->uv[0] * iw;
+		values[3][i] = v[i]->uv[1] * iw;
+		for (k = 0; k < 4; k++)
+			values[4 + k][i] = v[i]->colour[k] * iw;
+	}
+
+	// y points down, so this is positive for triangles OpenGL sees as clockwise
+	area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+	if (!(area > 0.0f))
+		return;
+
+	// pixels with their centre inside the bounds
+	min_x = std::min(x[0], std::min(x[1], x[2]));
+	min_y = std::min(y[0], std::min(y[1], y[2]));
+	max_x = std::max(x[0], std::max(x[1], x[2]));
+	max_y = std::max(y[0], std::max(y[1], y[2]));
+	if ((max_x < 0.5f) || (max_y < 0.5f) || (min_x > r.width - 0.5f) || (min_y > r.height - 0.5f))
+		return;
+
+	if (r.num_triangles == r.triangles.size())
+		r.triangles.resize(r.triangles.empty() ? 1024 : r.triangles.size() * 2);
+	vt_raster_triangle_t &t = r.triangles[r.num_triangles];
+
+	t.min_x = std::max((bit32)ceil(min_x - 0.5f), (bit32)0);
+	t.min_y = std::max((bit32)ceil(min_y - 0.5f), (bit32)0);
+	t.max_x = std::min((bit32)floor(max_x - 0.5f), r.width - 1);
+	t.max_y = std::min((bit32)floor(max_y - 0.5f), r.height - 1);
+	if ((t.min_x > t.max_x) || (t.min_y > t.max_y))
+		return;
+
+	for (i = 0; i < 3; i++) {
+		int j = (i + 1) % 3;
+
+		t.edges[i][0] = y[i] - y[j];
+		t.edges[i][1] = x[j] - x[i];
+		t.edges[i][2] = (y[j] - y[i]) * x[i] - (x[j] - x[i]) * y[i];
+	}
+	for (k = 0; k < VT_RASTER_NUM_PLANES; k++) {
+		float d1 = values[k][1] - values[k][0];
+		float d2 = values[k][2] - values[k][0];
+		float dx = (d1 * (y[2] - y[0]) - d2 * (y[1] - y[0])) / area;
+		float dy = (d2 * (x[1] - x[0]) - d1 * (x[2] - x[0])) / area;
+
+		t.planes[k][0] = dx;
+		t.planes[k][1] = dy;
+		t.planes[k][2] = values[k][0] - dx * x[0] - dy * y[0];
+	}
+	t.texture = texture;
+	t.texture_size = texture_size;
+
+	tx0 = t.min_x / VT_RASTER_TILE_SIZE;
+	ty0 = t.min_y / VT_RASTER_TILE_SIZE;
+	tx1 = t.max_x / VT_RASTER_TILE_SIZE;
+	ty1 = t.max_y / VT_RASTER_TILE_SIZE;
+	for (ty = ty0; ty <= ty1; ty++)
+		for (tx = tx0; tx <= tx1; tx++) {
+			bitu32 tile = ty * r.tiles_x + tx;
+			bitu32_array_t &bin = r.bins[tile];
+
+			if (r.bin_sizes[tile] == bin.size())
+				bin.resize(bin.empty() ? 256 : bin.size() * 2);
+			bin[r.bin_sizes[tile]++] = r.num_triangles;
+		}
+	r.num_triangles++;
+}
+
+/** \brief transforms a batch and adds its triangles to the tiles.
+  *
+  * matrix is the combined projection and modelview matrix in OpenGL order. texture is NULL
+  * for untextured batches, texture_size must be a power of two. If colour is not NULL it
+  * replaces the vertex colours of textured batches, like draw_batched_mesh in the viewer.
+  * The mesh and the texture must stay unchanged until vt_raster_flush.
+  */
+void vt_raster_draw_batch(vt_raster_t & r, const float *matrix, vt_batched_mesh_t & mesh, vt_batch_t & batch, const bitu32 *texture, bitu32 texture_size, const float *colour)
+{
+	bitu32 count = batch.max_vertex - batch.min_vertex + 1;
+	bitu32 i, k;
+
+	if (batch.num_indices == 0)
+		return;
+	if (r.clip.size() < count)
+		r.clip.resize(count);
+	for (i = 0; i < count; i++) {
+		vt_batch_vertex_t &v = mesh.vertices[batch.min_vertex + i];
+
+		r.clip[i].x = v.position[0];
+		r.clip[i].y = v.position[1];
+		r.clip[i].z = v.position[2];
+		r.clip[i].w = 1.0f;
+	}
+	vt_transform_vec4(matrix, &r.clip[0], &r.clip[0], count);
+	if (batch.tile == VT_BATCH_COLOURED) {
+		texture = NULL;
+		colour = NULL;
+	}
+
+	for (i = 0; i < batch.num_indices; i += 3) {
+		raster_vertex_t in[3], clipped[4];
+		const raster_vertex_t *tri[3];
+		int inside = 0, n = 0;
+
+		for (k = 0; k < 3; k++) {
+			bitu32 index = mesh.indices[batch.first_index + i + k];
+			vt_batch_vertex_t &v = mesh.vertices[index];
+			vt_vec4_t &p = r.clip[index - batch.min_vertex];
+
+			in[k].pos[0] = p.x;
+			in[k].pos[1] = p.y;
+			in[k].pos[2] = p.z;
+			in[k].pos[3] = p.w;
+			in[k].uv[0] = v.uv[0];
+			in[k].uv[1] = v.uv[1];
+			if (colour) {
+				in[k].colour[0] = colour[0];
+				in[k].colour[1] = colour[1];
+				in[k].colour[2] = colour[2];
+				in[k].colour[3] = colour[3];
+			} else {
+				in[k].colour[0] = v.colour.r / 255.0f;
+				in[k].colour[1] = v.colour.g / 255.0f;
+				in[k].colour[2] = v.colour.b / 255.0f;
+				in[k].colour[3] = v.colour.a / 255.0f;
+			}
+			if (p.z + p.w >= 0.0f)
+				inside++;
+		}
+		// completely outside one side of the frustum
+		if ((in[0].pos[0] > in[0].pos[3]) && (in[1].pos[0] > in[1].pos[3]) && (in[2].pos[0] > in[2].pos[3]))
+			continue;
+		if ((in[0].pos[0] < -in[0].pos[3]) && (in[1].pos[0] < -in[1].pos[3]) && (in[2].pos[0] < -in[2].pos[3]))
+			continue;
+		if ((in[0].pos[1] > in[0].pos[3]) && (in[1].pos[1] > in[1].pos[3]) && (in[2].pos[1] > in[2].pos[3]))
+			continue;
+		if ((in[0].pos[1] < -in[0].pos[3]) && (in[1].pos[1] < -in[1].pos[3]) && (in[2].pos[1] < -in[2].pos[3]))
+			continue;
+
+		if (inside == 3) {
+			tri[0] = &in[0];
+			tri[1] = &in[1];
+			tri[2] = &in[2];
+			setup_triangle(r, tri, texture, texture_size);
+			continue;
+		}
+		if (inside == 0)
+			continue;
+
+		// cut at the near plane, leaves a triangle or a quad
+		for (k = 0; k < 3; k++) {
+			const raster_vertex_t &a = in[k];
+			const raster_vertex_t &b = in[(k + 1) % 3];
+			bool a_in = (a.pos[2] + a.pos[3] >= 0.0f);
+			bool b_in = (b.pos[2] + b.pos[3] >= 0.0f);
+
+			if (a_in)
+				clipped[n++] = a;
+			if (a_in != b_in)
+				clip_near(a, b, clipped[n++]);
+		}
+		for (k = 1; k + 1 < (bitu32)n; k++) {
+			tri[0] = &clipped[0];
+			tri[1] = &clipped[k];
+			tri[2] = &clipped[k + 1];
+			setup_triangle(r, tri, texture, texture_size);
+		}
+	}
+}
+
+/// \brief returns the integer part of f rounded down.
+static inline bit32 floor_int(float f)
+{
+	bit32 i = (bit32)f;
+
+	return (f < (float)i) ? i - 1 : i;
+}
+
+/// \brief draws the triangles of one tile.
+static void shade_tile(vt_raster_t & r, bit32 tile)
+{
+	bit32 tile_x0 = (tile % r.tiles_x) * VT_RASTER_TILE_SIZE;
+	bit32 tile_y0 = (tile / r.tiles_x) * VT_RASTER_TILE_SIZE;
+	bit32 tile_x1 = std::min(tile_x0 + VT_RASTER_TILE_SIZE, r.width) - 1;
+	bit32 tile_y1 = std::min(tile_y0 + VT_RASTER_TILE_SIZE, r.height) - 1;
+	bitu32_array_t &bin = r.bins[tile];
+	bitu32 *colour_buffer = &r.colour[0];
+	float *depth_buffer = &r.depth[0];
+	bitu32 n;
+
+	for (n = 0; n < r.bin_sizes[tile]; n++) {
+		vt_raster_triangle_t &t = r.triangles[bin[n]];
+		bit32 x0 = std::max(t.min_x, tile_x0);
+		bit32 y0 = std::max(t.min_y, tile_y0);
+		bit32 x1 = std::min(t.max_x, tile_x1);
+		bit32 y1 = std::min(t.max_y, tile_y1);
+		bitu32 mask = t.texture_size - 1;
+		float size = (float)t.texture_size;
+		bit32 x, y;
+		int k;
+
+		for (y = y0; y <= y1; y++) {
+			float py = y + 0.5f;
+			float e[3], p[VT_RASTER_NUM_PLANES];
+			float span_x0 = (float)x0, span_x1 = (float)x1;
+			float px;
+			bitu32 offset;
+
+			// pixels between the edges, one pixel wider to be safe, the edges get tested anyway
+			for (k = 0; k < 3; k++) {
+				float a = t.edges[k][0];
+				float c = t.edges[k][1] * py + t.edges[k][2];
+
+				if (a > 0.0f)
+					span_x0 = std::max(span_x0, (float)floor(-c / a - 0.5f) - 1.0f);
+				else if (a < 0.0f)
+					span_x1 = std::min(span_x1, (float)ceil(-c / a - 0.5f) + 1.0f);
+				else if (c < 0.0f)
+					span_x1 = -1.0f;
+			}
+			if (span_x0 > span_x1)
+				continue;
+			x = (bit32)span_x0;
+			px = x + 0.5f;
+			offset = y * r.width + x;
+
+			for (k = 0; k < 3; k++)
+				e[k] = t.edges[k][0] * px + t.edges[k][1] * py + t.edges[k][2];
+			for (k = 0; k < VT_RASTER_NUM_PLANES; k++)
+				p[k] = t.planes[k][0] * px + t.planes[k][1] * py + t.planes[k][2];
+
+			for (; x <= (bit32)span_x1; x++, offset++) {
+				if ((e[0] >= 0.0f) && (e[1] >= 0.0f) && (e[2] >= 0.0f) && (p[0] < depth_buffer[offset])) {
+					float w = 1.0f / p[1];
+					bitu32 texel = 0xffffffff;
+					bitu8 *c = (bitu8 *)&texel;
+					bitu32 alpha;
+
+					if (t.texture) {
+						bitu32 u = (bitu32)floor_int(p[2] * w * size) & mask;
+						bitu32 v = (bitu32)floor_int(p[3] * w * size) & mask;
+
+						texel = t.texture[v * t.texture_size + u];
+					}
+					alpha = (bitu32)(c[3] * std::min(p[7] * w, 1.0f));
+					// glAlphaFunc(GL_GEQUAL, 0.5f)
+					if (alpha >= 128) {
+						c[0] = (bitu8)(c[0] * std::min(p[4] * w, 1.0f) + 0.5f);
+						c[1] = (bitu8)(c[1] * std::min(p[5] * w, 1.0f) + 0.5f);
+						c[2] = (bitu8)(c[2] * std::min(p[6] * w, 1.0f) + 0.5f);
+						c[3] = (bitu8)alpha;
+						colour_buffer[offset] = texel;
+						depth_buffer[offset] = p[0];
+					}
+				}
+				for (k = 0; k < 3; k++)
+					e[k] += t.edges[k][0];
+				for (k = 0; k < VT_RASTER_NUM_PLANES; k++)
+					p[k] += t.planes[k][0];
+			}
+		}
+	}
+}
+
+/// \brief shades tiles until none are left.
+static void shade_tiles(vt_raster_t & r)
+{
+	bit32 num_tiles = r.tiles_x * r.tiles_y;
+
+	for (;;) {
+		bit32 tile;
+
+		SDL_mutexP(r.lock);
+		tile = r.next_tile++;
+		SDL_mutexV(r.lock);
+		if (tile >= num_tiles)
+			break;
+		shade_tile(r, tile);
+	}
+}
+
+static int raster_worker(void *data)
+{
+	vt_raster_t &r = *(vt_raster_t *)data;
+
+	for (;;) {
+		SDL_SemWait(r.start);
+		if (r.quit)
+			break;
+		shade_tiles(r);
+		SDL_SemPost(r.done);
+	}
+
+	return 0;
+}
+
+/// \brief draws all triangles since the last flush into the buffers.
+void vt_raster_flush(vt_raster_t & r)
+{
+	bit32 i;
+
+	r.next_tile = 0;
+	for (i = 0; i < r.num_threads - 1; i++)
+		SDL_SemPost(r.start);
+	shade_tiles(r);
+	for (i = 0; i < r.num_threads - 1; i++)
+		SDL_SemWait(r.done);
+
+	r.num_triangles = 0;
+	for (i = 0; i < (bit32)r.bin_sizes.size(); i++)
+		r.bin_sizes[i] = 0;
+}
+
+/// \brief returns the number of processors, a sensible num_threads for vt_raster_init.
+bit32 vt_raster_cpu_count()
+{
+#ifdef _WIN32
+	SYSTEM_INFO info;
+
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors;
+#else
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return (count > 0) ? count : 1;
+#endif
+}
+
+/// \brief sets m to the identity matrix.
+void vt_matrix_identity(float *m)
+{
+	int i;
+
+	for (i = 0; i < 16; i++)
+		m[i] = (i % 5 == 0) ? 1.0f : 0.0f;
+}
+
+/// \brief out = a * b, all in OpenGL (column major) order. out may be a or b.
+void vt_matrix_multiply(float *out, const float *a, const float *b)
+{
+	float m[16];
+	int i, j;
+
+	for (i = 0; i < 4; i++)
+		for (j = 0; j < 4; j++)
+			m[j * 4 + i] = a[i] * b[j * 4] + a[4 + i] * b[j * 4 + 1] + a[8 + i] * b[j * 4 + 2] + a[12 + i] * b[j * 4 + 3];
+	memcpy(out, m, sizeof(m));
+}
+
+/// \brief multiplies m with a translation, like glTranslatef.
+void vt_matrix_translate(float *m, float x, float y, float z)
+{
+	int i;
+
+	for (i = 0; i < 4; i++)
+		m[12 + i] += m[i] * x + m[4 + i] * y + m[8 + i] * z;
+}
+
+/// \brief multiplies m with a rotation by angle degrees around x, y, z, like glRotatef.
+void vt_matrix_rotate(float *m, float angle, float x, float y, float z)
+{
+	float r[16];
+	float len = (float)sqrt(x * x + y * y + z * z);
+	float s, c, t;
+
+	if (len == 0.0f)
+		return;
+	x /= len;
+	y /= len;
+	z /= len;
+	s = (float)sin(angle * (M_PI / 180.0));
+	c = (float)cos(angle * (M_PI / 180.0));
+	t = 1.0f - c;
+
+	r[0] = x * x * t + c;
+	r[1] = y * x * t + z * s;
+	r[2] = x * z * t - y * s;
+	r[3] = 0.0f;
+	r[4] = x * y * t - z * s;
+	r[5] = y * y * t + c;
+	r[6] = y * z * t + x * s;
+	r[7] = 0.0f;
+	r[8] = x * z * t + y * s;
+	r[9] = y * z * t - x * s;
+	r[10] = z * z * t + c;
+	r[11] = 0.0f;
+	r[12] = r[13] = r[14] = 0.0f;
+	r[15] = 1.0f;
+	vt_matrix_multiply(m, m, r);
+}
+
+/// \brief sets m to the projection of infinitePerspective in the viewer.
+void vt_matrix_infinite_perspective(float *m, float fovy, float aspect, float znear)
+{
+	float top = znear * (float)tan(fovy * M_PI / 360.0);
+	float right = top * aspect;
+
+	memset(m, 0, 16 * sizeof(float));
+	m[0] = znear / right;
+	m[5] = znear / top;
+	m[10] = -1.0f;
+	m[11] = -1.0f;
+	m[14] = -2.0f * znear;
+}
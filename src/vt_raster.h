@@ -0,0 +1,70 @@
+#ifndef _VT_RASTER_H_
+#define _VT_RASTER_H_
+
+#include "SDL_thread.h"
+#include "vt_level.h"
+
+#define VT_RASTER_TILE_SIZE 64	///< \brief width and height of a screen tile in pixels.
+#define VT_RASTER_MAX_THREADS 32	///< \brief upper limit of the shading threads.
+#define VT_RASTER_NUM_PLANES 8	///< \brief interpolated values: z, 1/w, u/w, v/w, r/w, g/w, b/w, a/w.
+
+/** \brief Triangle after setup, in pixel coordinates.
+  *
+  * Every value is a plane v = p[0] * x + p[1] * y + p[2] over the pixel centres. The edges are
+  * positive inside.
+  */
+typedef struct {
+	float edges[3][3];	///< \brief edge functions.
+	float planes[VT_RASTER_NUM_PLANES][3];	///< \brief interpolated values.
+	const bitu32 *texture;	///< \brief texels, NULL for untextured triangles.
+	bitu32 texture_size;	///< \brief width and height of texture, a power of two.
+	bit32 min_x, min_y;	///< \brief first pixel of the bounding box.
+	bit32 max_x, max_y;	///< \brief last pixel of the bounding box.
+} vt_raster_triangle_t;
+typedef prtl::array < vt_raster_triangle_t > vt_raster_triangle_array_t;
+
+typedef prtl::array < float > vt_float_array_t;
+
+/** \brief Multithreaded software renderer.
+  *
+  * Draws the batched geometry of VT_Level like the OpenGL renderer does: perspective correct
+  * textures modulated by the vertex colour, alpha test (alpha >= 0.5), depth test (less) and
+  * culling of front faces. vt_raster_draw_batch sets up the triangles and sorts them into
+  * screen tiles of VT_RASTER_TILE_SIZE pixels, vt_raster_flush shades the tiles on all threads.
+  * The colour buffer holds RGBA8 pixels (memory order r, g, b, a) from the top row down.
+  */
+typedef struct {
+	bit32 width;		///< \brief width of the buffers in pixels.
+	bit32 height;		///< \brief height of the buffers in pixels.
+	bit32 tiles_x;		///< \brief tiles per row.
+	bit32 tiles_y;		///< \brief rows of tiles.
+	bitu32_array_t colour;	///< \brief colour buffer, width * height pixels.
+	vt_float_array_t depth;	///< \brief depth buffer, same layout as colour.
+	vt_raster_triangle_array_t triangles;	///< \brief triangles since the last flush, num_triangles are used.
+	bitu32 num_triangles;	///< \brief used entries of triangles.
+	prtl::array < bitu32_array_t > bins;	///< \brief triangle indices of every tile, in drawing order.
+	bitu32_array_t bin_sizes;	///< \brief used entries of every bin.
+	vt_vec4_array_t clip;	///< \brief clip space positions of the current batch.
+	bit32 num_threads;	///< \brief shading threads, including the caller of vt_raster_flush.
+	SDL_Thread *threads[VT_RASTER_MAX_THREADS];	///< \brief worker threads.
+	SDL_sem *start;		///< \brief posted once per worker for every flush.
+	SDL_sem *done;		///< \brief posted by every worker when it ran out of tiles.
+	SDL_mutex *lock;	///< \brief protects next_tile.
+	bit32 next_tile;	///< \brief next tile to shade.
+	bool quit;		///< \brief tells the workers to exit.
+} vt_raster_t;
+
+void vt_raster_init(vt_raster_t & r, bit32 width, bit32 height, bit32 num_threads);
+void vt_raster_free(vt_raster_t & r);
+void vt_raster_clear(vt_raster_t & r, tr2_colour_t colour);
+void vt_raster_draw_batch(vt_raster_t & r, const float *matrix, vt_batched_mesh_t & mesh, vt_batch_t & batch, const bitu32 *texture, bitu32 texture_size, const float *colour);
+void vt_raster_flush(vt_raster_t & r);
+bit32 vt_raster_cpu_count();
+
+void vt_matrix_identity(float *m);
+void vt_matrix_multiply(float *out, const float *a, const float *b);
+void vt_matrix_translate(float *m, float x, float y, float z);
+void vt_matrix_rotate(float *m, float angle, float x, float y, float z);
+void vt_matrix_infinite_perspective(float *m, float fovy, float aspect, float znear);
+
+#endif // _VT_RASTER_H_
@@ -0,0 +1,333 @@
+/*
+ * Copyright 2002 - Florian Schulze <crow@icculus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * This file is part of vt.
+ *
+ */
+
+#include <stdlib.h>
+#include <math.h>
+#include "vt_rooms.h"
+
+#define RCSID "$Id$"
+
+#define MAX_GRID_CELLS (1 << 20)	///< \brief the cells get larger if a level needs more.
+
+/// \brief cell range covered by a room, inclusive.
+static void get_room_cells(tr5_room_t & room, float cell_size, bit32 & x1, bit32 & z1, bit32 & x2, bit32 & z2)
+{
+	x1 = (bit32)floor(room.offset.x / cell_size);
+	x2 = (bit32)floor((room.offset.x + room.num_xsectors * 1024.0f) / cell_size);
+	z1 = (bit32)floor((room.offset.z - room.num_zsectors * 1024.0f) / cell_size);
+	z2 = (bit32)floor(room.offset.z / cell_size);
+}
+
+/** \brief builds the room grid.
+  *
+  * A room gets entered into every cell its sectors touch, including the cells on its border,
+  * vt_locate does the exact test.
+  */
+void vt_build_room_grid(tr5_room_array_t & rooms, vt_room_grid_t & grid)
+{
+	bit32 min_x = 0, min_z = 0, max_x = 0, max_z = 0;
+	bit32 x, z, x1, z1, x2, z2;
+	bitu32 i, num_cells;
+
+	grid.cell_size = 1024.0f;
+	grid.min_x = grid.min_z = 0;
+	grid.size_x = grid.size_z = 0;
+	grid.cell_start.resize(0);
+	grid.rooms.resize(0);
+	if (rooms.empty())
+		return;
+
+	for (;;) {
+		for (i = 0; i < rooms.size(); i++) {
+			get_room_cells(rooms[i], grid.cell_size, x1, z1, x2, z2);
+			if ((i == 0) || (x1 < min_x))
+				min_x = x1;
+			if ((i == 0) || (z1 < min_z))
+				min_z = z1;
+			if ((i == 0) || (x2 > max_x))
+				max_x = x2;
+			if ((i == 0) || (z2 > max_z))
+				max_z = z2;
+		}
+		if ((double)(max_x - min_x + 1) * (double)(max_z - min_z + 1) <= MAX_GRID_CELLS)
+			break;
+		grid.cell_size *= 2.0f;
+	}
+
+	grid.min_x = min_x;
+	grid.min_z = min_z;
+	grid.size_x = max_x - min_x + 1;
+	grid.size_z = max_z - min_z + 1;
+	num_cells = grid.size_x * grid.size_z;
+
+	// count the candidates of every cell, then turn the counts into offsets
+	grid.cell_start.resize(num_cells + 1, 0);
+	for (i = 0; i < rooms.size(); i++) {
+		get_room_cells(rooms[i], grid.cell_size, x1, z1, x2, z2);
+		for (x = x1; x <= x2; x++)
+			for (z = z1; z <= z2; z++)
+				grid.cell_start[(x - min_x) * grid.size_z + (z - min_z) + 1]++;
+	}
+	for (i = 0; i < num_cells; i++)
+		grid.cell_start[i + 1] += grid.cell_start[i];
+
+	bitu32_array_t fill(num_cells);
+
+	for (i = 0; i < num_cells; i++)
+		fill[i] = grid.cell_start[i];
+	grid.rooms.resize(grid.cell_start[num_cells]);
+	for (i = 0; i < rooms.size(); i++) {
+		get_room_cells(rooms[i], grid.cell_size, x1, z1, x2, z2);
+		for (x = x1; x <= x2; x++)
+			for (z = z1; z <= z2; z++)
+				grid.rooms[fill[(x - min_x) * grid.size_z + (z - min_z)]++] = i;
+	}
+}
+
+/// \brief returns true and the sector if pos is inside the sectors and height range of room.
+bool vt_room_contains(tr5_room_t & room, const vec3_t & pos, bitu32 & sector)
+{
+	float sx, sz;
+
+	if ((pos.y < room.y_bottom) || (pos.y > room.y_top))
+		return false;
+
+	sx = (pos.x - room.offset.x) / 1024.0f;
+	sz = (room.offset.z - pos.z) / 1024.0f;
+	if ((sx < 0.0f) || (sz < 0.0f) || (sx >= (float)room.num_xsectors) || (sz >= (float)room.num_zsectors))
+		return false;
+
+	sector = (bitu32)sx * room.num_zsectors + (bitu32)sz;
+	return true;
+}
+
+/** \brief finds the room and sector containing pos.
+  *
+  * Rooms which are the alternate of another room (flipped rooms) are only returned if no normal
+  * room contains pos. Returns false and sets loc.room to VT_ROOM_NONE if pos is outside of all rooms.
+  */
+bool vt_locate(tr5_room_array_t & rooms, vt_room_grid_t & grid, const vec3_t & pos, vt_location_t & loc)
+{
+	bit32 x, z;
+	bitu32 i, cell, sector;
+
+	loc.room = VT_ROOM_NONE;
+	loc.sector = 0;
+
+	x = (bit32)floor(pos.x / grid.cell_size) - grid.min_x;
+	z = (bit32)floor(pos.z / grid.cell_size) - grid.min_z;
+	if ((x < 0) || (z < 0) || ((bitu32)x >= grid.size_x) || ((bitu32)z >= grid.size_z))
+		return false;
+
+	cell = x * grid.size_z + z;
+	for (i = grid.cell_start[cell]; i < grid.cell_start[cell + 1]; i++) {
+		bitu32 room = grid.rooms[i];
+
+		if (!vt_room_contains(rooms[room], pos, sector))
+			continue;
+		if ((loc.room == VT_ROOM_NONE) || (rooms[room].alternate_room == (bit16)loc.room)) {
+			// take the first hit, but replace an alternate room by its normal room
+			loc.room = room;
+			loc.sector = sector;
+		}
+	}
+
+	return loc.room != VT_ROOM_NONE;
+}
+
+/** \brief returns the alternate room of room, VT_ROOM_NONE if there is none.
+  *
+  * A link which is stored in both rooms is only returned for the lower room number, so every
+  * link is only counted once.
+  */
+static bitu32 get_alternate_link(tr5_room_array_t & rooms, bitu32 room)
+{
+	bit32 other = rooms[room].alternate_room;
+
+	if ((other < 0) || ((bitu32)other >= rooms.size()) || ((bitu32)other == room))
+		return VT_ROOM_NONE;
+	if ((rooms[other].alternate_room == (bit32)room) && ((bitu32)other < room))
+		return VT_ROOM_NONE;
+
+	return other;
+}
+
+/// \brief fills in a portal edge.
+static void set_portal_edge(tr5_room_t & room, bitu32 portal_index, vt_room_edge_t & edge)
+{
+	tr_room_portal_t & portal = room.portals[portal_index];
+	bitu32 k;
+
+	edge.room = portal.adjoining_room;
+	edge.portal = portal_index;
+	for (k = 0; k < 4; k++)
+		edge.vertices[k] = portal.vertices[k] + room.offset;
+	edge.normal = portal.normal;
+	edge.normal.normalize();
+	edge.dist = edge.normal.dot(edge.vertices[0]);
+	edge.min = edge.max = edge.vertices[0];
+	for (k = 1; k < 4; k++) {
+		if (edge.vertices[k].x < edge.min.x) edge.min.x = edge.vertices[k].x;
+		if (edge.vertices[k].y < edge.min.y) edge.min.y = edge.vertices[k].y;
+		if (edge.vertices[k].z < edge.min.z) edge.min.z = edge.vertices[k].z;
+		if (edge.vertices[k].x > edge.max.x) edge.max.x = edge.vertices[k].x;
+		if (edge.vertices[k].y > edge.max.y) edge.max.y = edge.vertices[k].y;
+		if (edge.vertices[k].z > edge.max.z) edge.max.z = edge.vertices[k].z;
+	}
+}
+
+/// \brief fills in an alternate room link.
+static void set_alternate_edge(bitu32 other, vt_room_edge_t & edge)
+{
+	edge.room = other;
+	edge.portal = VT_EDGE_ALTERNATE;
+	edge.normal = edge.min = edge.max = vec3_t();
+	edge.dist = 0.0f;
+}
+
+/** \brief finds the room closest to pos.
+  *
+  * The distance is measured to the box spanned by the sectors and the height range of each room,
+  * so any room containing pos has distance 0. On equal distance the lower room index wins.
+  * Returns VT_ROOM_NONE if there are no rooms. This is a linear search, use vt_locate first.
+  */
+bitu32 vt_nearest_room(tr5_room_array_t & rooms, const vec3_t & pos)
+{
+	bitu32 best = VT_ROOM_NONE;
+	float best_dist = 0.0f;
+	bitu32 i;
+
+	for (i = 0; i < rooms.size(); i++) {
+		tr5_room_t & room = rooms[i];
+		float min_x = room.offset.x, max_x = room.offset.x + room.num_xsectors * 1024.0f;
+		float min_z = room.offset.z - room.num_zsectors * 1024.0f, max_z = room.offset.z;
+		float dx = 0.0f, dy = 0.0f, dz = 0.0f;
+		float dist;
+
+		if (pos.x < min_x)
+			dx = min_x - pos.x;
+		else if (pos.x > max_x)
+			dx = pos.x - max_x;
+		if (pos.y < room.y_bottom)
+			dy = room.y_bottom - pos.y;
+		else if (pos.y > room.y_top)
+			dy = pos.y - room.y_top;
+		if (pos.z < min_z)
+			dz = min_z - pos.z;
+		else if (pos.z > max_z)
+			dz = pos.z - max_z;
+
+		dist = dx * dx + dy * dy + dz * dz;
+		if ((best == VT_ROOM_NONE) || (dist < best_dist)) {
+			best = i;
+			best_dist = dist;
+		}
+	}
+
+	return best;
+}
+
+/** \brief builds the room adjacency graph.
+  *
+  * Portals to rooms that do not exist are left out.
+  */
+void vt_build_room_graph(tr5_room_array_t & rooms, vt_room_graph_t & graph)
+{
+	bitu32 num_rooms = rooms.size();
+	bitu32 i, j, other;
+
+	// count the edges of every room, then turn the counts into offsets
+	graph.edge_start.resize(0);
+	graph.edge_start.resize(num_rooms + 1, 0);
+	for (i = 0; i < num_rooms; i++) {
+		for (j = 0; j < rooms[i].portals.size(); j++)
+			if (rooms[i].portals[j].adjoining_room < num_rooms)
+				graph.edge_start[i + 1]++;
+		if ((other = get_alternate_link(rooms, i)) != VT_ROOM_NONE) {
+			graph.edge_start[i + 1]++;
+			graph.edge_start[other + 1]++;
+		}
+	}
+	for (i = 0; i < num_rooms; i++)
+		graph.edge_start[i + 1] += graph.edge_start[i];
+
+	bitu32_array_t fill(num_rooms);
+
+	graph.edges.resize(0);
+	graph.edges.resize(graph.edge_start[num_rooms]);
+	for (i = 0; i < num_rooms; i++) {
+		fill[i] = graph.edge_start[i];
+		for (j = 0; j < rooms[i].portals.size(); j++)
+			if (rooms[i].portals[j].adjoining_room < num_rooms)
+				set_portal_edge(rooms[i], j, graph.edges[fill[i]++]);
+	}
+	for (i = 0; i < num_rooms; i++) {
+		if ((other = get_alternate_link(rooms, i)) == VT_ROOM_NONE)
+			continue;
+		set_alternate_edge(other, graph.edges[fill[i]++]);
+		set_alternate_edge(i, graph.edges[fill[other]++]);
+	}
+}
+
+/** \brief finds all rooms reachable from start over at most max_edges edges.
+  *
+  * Breadth first search, alternate room links are only followed if alternates is set.
+  * The rooms get stored in result in the order they are found (start first, then by increasing
+  * distance), distance is set to the number of edges to each room or VT_ROOM_NONE if it is not
+  * reachable. Both arrays are resized to the number of rooms. Returns the number of rooms found.
+  */
+bitu32 vt_rooms_within(vt_room_graph_t & graph, bitu32 start, bitu32 max_edges, bool alternates, bitu32_array_t & result, bitu32_array_t & distance)
+{
+	bitu32 num_rooms = graph.edge_start.empty() ? 0 : graph.edge_start.size() - 1;
+	bitu32 head = 0, tail = 0;
+	bitu32 i;
+
+	if (result.size() != num_rooms)
+		result.resize(num_rooms);
+	if (distance.size() != num_rooms)
+		distance.resize(num_rooms);
+	for (i = 0; i < num_rooms; i++)
+		distance[i] = VT_ROOM_NONE;
+	if (start >= num_rooms)
+		return 0;
+
+	distance[start] = 0;
+	result[tail++] = start;
+	while (head < tail) {
+		bitu32 room = result[head++];
+		bitu32 end = graph.edge_start[room + 1];
+
+		if (distance[room] >= max_edges)
+			continue;
+		for (i = graph.edge_start[room]; i < end; i++) {
+			vt_room_edge_t & edge = graph.edges[i];
+
+			if ((edge.portal == VT_EDGE_ALTERNATE) && !alternates)
+				continue;
+			if (distance[edge.room] != VT_ROOM_NONE)
+				continue;
+			distance[edge.room] = distance[room] + 1;
+			result[tail++] = edge.room;
+		}
+	}
+
+	return tail;
+}
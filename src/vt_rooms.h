@@ -0,0 +1,64 @@
+#ifndef _VT_ROOMS_H_
+#define _VT_ROOMS_H_
+
+#include "tr_types.h"
+
+#define VT_ROOM_NONE 0xffffffff	///< \brief no room.
+#define VT_EDGE_ALTERNATE 0xffffffff	///< \brief vt_room_edge_t::portal of an alternate room link.
+
+/// \brief Result of a position lookup.
+typedef struct {
+	bitu32 room;		///< \brief index into rooms, VT_ROOM_NONE if not found.
+	bitu32 sector;		///< \brief index into the sector_list of that room.
+} vt_location_t;
+
+/** \brief 2D grid of candidate rooms.
+  *
+  * Covers the x/z extent of all rooms with cells of cell_size units (1024 unless the level is
+  * very large). The candidates of cell (x, z) are rooms[cell_start[i]] up to (excluding)
+  * rooms[cell_start[i + 1]], with i = x * size_z + z.
+  */
+typedef struct {
+	bit32 min_x;		///< \brief x of the first cell in cell units.
+	bit32 min_z;		///< \brief z of the first cell in cell units.
+	bitu32 size_x;		///< \brief number of cells along x.
+	bitu32 size_z;		///< \brief number of cells along z.
+	float cell_size;	///< \brief width of a cell.
+	bitu32_array_t cell_start;	///< \brief size_x * size_z + 1 offsets into rooms.
+	bitu32_array_t rooms;	///< \brief candidate rooms of all cells.
+} vt_room_grid_t;
+
+/** \brief Edge of the room graph.
+  *
+  * Either a portal or a link between a room and its alternate room (both directions). All
+  * coordinates are in world space, plane and bounds are not set for alternate links.
+  */
+typedef struct {
+	bitu32 room;		///< \brief room on the other side.
+	bitu32 portal;		///< \brief index into the portals of the source room, or VT_EDGE_ALTERNATE.
+	vec3_t normal;		///< \brief portal plane normal, pointing into the source room.
+	float dist;		///< \brief portal plane distance, normal.dot(p) == dist for points on the plane.
+	vec3_t min;		///< \brief lower corner of the portal bounds.
+	vec3_t max;		///< \brief upper corner of the portal bounds.
+	vec3_t vertices[4];	///< \brief portal corners.
+} vt_room_edge_t;
+typedef prtl::array < vt_room_edge_t > vt_room_edge_array_t;
+
+/** \brief Room adjacency graph in compressed sparse row form.
+  *
+  * The edges of room i are edges[edge_start[i]] up to (excluding) edges[edge_start[i + 1]],
+  * the portals in their original order followed by the alternate room links.
+  */
+typedef struct {
+	bitu32_array_t edge_start;	///< \brief rooms.size() + 1 offsets into edges.
+	vt_room_edge_array_t edges;	///< \brief edges of all rooms.
+} vt_room_graph_t;
+
+void vt_build_room_grid(tr5_room_array_t & rooms, vt_room_grid_t & grid);
+bool vt_room_contains(tr5_room_t & room, const vec3_t & pos, bitu32 & sector);
+bool vt_locate(tr5_room_array_t & rooms, vt_room_grid_t & grid, const vec3_t & pos, vt_location_t & loc);
+bitu32 vt_nearest_room(tr5_room_array_t & rooms, const vec3_t & pos);
+void vt_build_room_graph(tr5_room_array_t & rooms, vt_room_graph_t & graph);
+bitu32 vt_rooms_within(vt_room_graph_t & graph, bitu32 start, bitu32 max_edges, bool alternates, bitu32_array_t & result, bitu32_array_t & distance);
+
+#endif // _VT_ROOMS_H_
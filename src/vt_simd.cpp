@@ -0,0 +1,204 @@
+/*
+ * Copyright 2002 - Florian Schulze <crow@icculus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * This file is part of vt.
+ *
+ */
+
+#include <stdlib.h>
+#include <float.h>
+#include "vt_simd.h"
+#ifdef VT_SSE2
+#include <emmintrin.h>
+#endif
+
+#define RCSID "$Id$"
+
+/** \brief calculates the axis aligned bounding box of a position stream.
+  *
+  * min and max get set to FLT_MAX / -FLT_MAX if count is 0.
+  */
+void vt_bounds_vec4(const vt_vec4_t *in, bitu32 count, vt_vec4_t & min, vt_vec4_t & max)
+{
+	bitu32 i;
+#ifdef VT_SSE2
+	__m128 vmin = _mm_set1_ps(FLT_MAX);
+	__m128 vmax = _mm_set1_ps(-FLT_MAX);
+
+	for (i = 0; i < count; i++) {
+		__m128 v = _mm_loadu_ps(&in[i].x);
+
+		vmin = _mm_min_ps(vmin, v);
+		vmax = _mm_max_ps(vmax, v);
+	}
+	_mm_storeu_ps(&min.x, vmin);
+	_mm_storeu_ps(&max.x, vmax);
+#else
+	min.x = min.y = min.z = min.w = FLT_MAX;
+	max.x = max.y = max.z = max.w = -FLT_MAX;
+	for (i = 0; i < count; i++) {
+		if (in[i].x < min.x) min.x = in[i].x;
+		if (in[i].y < min.y) min.y = in[i].y;
+		if (in[i].z < min.z) min.z = in[i].z;
+		if (in[i].w < min.w) min.w = in[i].w;
+		if (in[i].x > max.x) max.x = in[i].x;
+		if (in[i].y > max.y) max.y = in[i].y;
+		if (in[i].z > max.z) max.z = in[i].z;
+		if (in[i].w > max.w) max.w = in[i].w;
+	}
+#endif
+}
+
+/** \brief transforms a position stream by a 4x4 matrix.
+  *
+  * matrix is in OpenGL (column major) order. in and out may be the same stream.
+  */
+void vt_transform_vec4(const float *matrix, const vt_vec4_t *in, vt_vec4_t *out, bitu32 count)
+{
+	bitu32 i;
+#ifdef VT_SSE2
+	__m128 c0 = _mm_loadu_ps(&matrix[0]);
+	__m128 c1 = _mm_loadu_ps(&matrix[4]);
+	__m128 c2 = _mm_loadu_ps(&matrix[8]);
+	__m128 c3 = _mm_loadu_ps(&matrix[12]);
+
+	for (i = 0; i < count; i++) {
+		__m128 v = _mm_loadu_ps(&in[i].x);
+		__m128 r;
+
+		r = _mm_mul_ps(c0, _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0)));
+		r = _mm_add_ps(r, _mm_mul_ps(c1, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1))));
+		r = _mm_add_ps(r, _mm_mul_ps(c2, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2))));
+		r = _mm_add_ps(r, _mm_mul_ps(c3, _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3))));
+		_mm_storeu_ps(&out[i].x, r);
+	}
+#else
+	for (i = 0; i < count; i++) {
+		vt_vec4_t v = in[i];
+
+		out[i].x = matrix[0] * v.x + matrix[4] * v.y + matrix[8] * v.z + matrix[12] * v.w;
+		out[i].y = matrix[1] * v.x + matrix[5] * v.y + matrix[9] * v.z + matrix[13] * v.w;
+		out[i].z = matrix[2] * v.x + matrix[6] * v.y + matrix[10] * v.z + matrix[14] * v.w;
+		out[i].w = matrix[3] * v.x + matrix[7] * v.y + matrix[11] * v.z + matrix[15] * v.w;
+	}
+#endif
+}
+
+/** \brief expands a 16-bit position stream to floats.
+  *
+  * out[i] = in[i] + origin for all four components.
+  */
+void vt_expand_vec4_16(const vt_vec4_16_t *in, const vt_vec4_t & origin, vt_vec4_t *out, bitu32 count)
+{
+	bitu32 i = 0;
+#ifdef VT_SSE2
+	__m128 o = _mm_loadu_ps(&origin.x);
+
+	for (; i + 2 <= count; i += 2) {
+		__m128i v = _mm_loadu_si128((const __m128i *)&in[i]);
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+		__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+
+		_mm_storeu_ps(&out[i].x, _mm_add_ps(_mm_cvtepi32_ps(lo), o));
+		_mm_storeu_ps(&out[i + 1].x, _mm_add_ps(_mm_cvtepi32_ps(hi), o));
+	}
+#endif
+	for (; i < count; i++) {
+		out[i].x = (float)in[i].x + origin.x;
+		out[i].y = (float)in[i].y + origin.y;
+		out[i].z = (float)in[i].z + origin.z;
+		out[i].w = (float)in[i].w + origin.w;
+	}
+}
+
+/** \brief halves a square RGBA8 image with an alpha weighted 2x2 box filter.
+  *
+  * src is size * size texels (memory order r, g, b, a), dst gets (size / 2) * (size / 2).
+  * The colour is averaged like premultiplied texels and divided by the alpha again, so
+  * transparent texels (the colour key of the 8-bit textiles) don't bleed into their neighbours;
+  * it is black where all four are transparent. The alpha is the plain average. Both code
+  * paths do the same float operations and give the same result.
+  */
+void vt_downsample_rgba8(const bitu32 *src, bitu32 size, bitu32 *dst)
+{
+	bitu32 half = size / 2;
+	bitu32 x, y;
+#ifdef VT_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128 rgb_mask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+	const __m128 alpha_mask = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+	const __m128 alpha_one = _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f);
+	const __m128 quarter = _mm_set1_ps(0.25f);
+	const __m128 round = _mm_set1_ps(0.5f);
+	const __m128 zero_ps = _mm_setzero_ps();
+
+	for (y = 0; y < half; y++) {
+		const bitu32 *row0 = src + y * 2 * size;
+		const bitu32 *row1 = row0 + size;
+
+		for (x = 0; x < half; x++) {
+			__m128i top = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)&row0[x * 2]), zero);
+			__m128i bottom = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)&row1[x * 2]), zero);
+			__m128 p[4], sum, alpha, colour;
+			__m128i out;
+			int i;
+
+			p[0] = _mm_cvtepi32_ps(_mm_unpacklo_epi16(top, zero));
+			p[1] = _mm_cvtepi32_ps(_mm_unpackhi_epi16(top, zero));
+			p[2] = _mm_cvtepi32_ps(_mm_unpacklo_epi16(bottom, zero));
+			p[3] = _mm_cvtepi32_ps(_mm_unpackhi_epi16(bottom, zero));
+			// r * a, g * a, b * a, a
+			sum = zero_ps;
+			for (i = 0; i < 4; i++) {
+				__m128 weight = _mm_or_ps(_mm_and_ps(_mm_shuffle_ps(p[i], p[i], _MM_SHUFFLE(3, 3, 3, 3)), rgb_mask), alpha_one);
+
+				sum = _mm_add_ps(sum, _mm_mul_ps(p[i], weight));
+			}
+			alpha = _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(3, 3, 3, 3));
+			colour = _mm_and_ps(_mm_div_ps(sum, alpha), _mm_cmpneq_ps(alpha, zero_ps));
+			colour = _mm_or_ps(_mm_and_ps(colour, rgb_mask), _mm_and_ps(_mm_mul_ps(sum, quarter), alpha_mask));
+			out = _mm_cvttps_epi32(_mm_add_ps(colour, round));
+			out = _mm_packs_epi32(out, out);
+			out = _mm_packus_epi16(out, out);
+			dst[y * half + x] = (bitu32)_mm_cvtsi128_si32(out);
+		}
+	}
+#else
+	for (y = 0; y < half; y++) {
+		const bitu8 *row0 = (const bitu8 *)(src + y * 2 * size);
+		const bitu8 *row1 = row0 + size * 4;
+
+		for (x = 0; x < half; x++) {
+			const bitu8 *p[4] = { row0 + x * 8, row0 + x * 8 + 4, row1 + x * 8, row1 + x * 8 + 4 };
+			float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			bitu8 *out = (bitu8 *)&dst[y * half + x];
+			int i, c;
+
+			for (i = 0; i < 4; i++) {
+				float a = (float)p[i][3];
+
+				for (c = 0; c < 3; c++)
+					sum[c] += (float)p[i][c] * a;
+				sum[3] += a;
+			}
+			for (c = 0; c < 3; c++)
+				out[c] = (sum[3] != 0.0f) ? (bitu8)(sum[c] / sum[3] + 0.5f) : 0;
+			out[3] = (bitu8)(sum[3] * 0.25f + 0.5f);
+		}
+	}
+#endif
+}
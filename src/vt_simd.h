@@ -0,0 +1,55 @@
+#ifndef _VT_SIMD_H_
+#define _VT_SIMD_H_
+
+#include "tr_types.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define VT_SSE2 1
+#endif
+
+/** \brief Four component float vector.
+  *
+  * Used as the element of position streams. The fourth component is padding (1.0f for positions),
+  * so every vertex fills exactly one SIMD register.
+  */
+typedef struct {
+	float x;
+	float y;
+	float z;
+	float w;
+} vt_vec4_t;
+typedef prtl::array < vt_vec4_t > vt_vec4_array_t;
+
+/** \brief Four component 16-bit integer vector.
+  *
+  * Compact form of vt_vec4_t for values which are integers on disk.
+  */
+typedef struct {
+	bit16 x;
+	bit16 y;
+	bit16 z;
+	bit16 w;
+} vt_vec4_16_t;
+typedef prtl::array < vt_vec4_16_t > vt_vec4_16_array_t;
+
+/** \brief Normal packed to signed bytes.
+  *
+  * x, y and z are scaled by 127, w is padding.
+  */
+typedef struct {
+	bit8 x;
+	bit8 y;
+	bit8 z;
+	bit8 w;
+} vt_normal8_t;
+typedef prtl::array < vt_normal8_t > vt_normal8_array_t;
+
+/// \brief RGBA8 colour stream element (memory order r, g, b, a).
+typedef prtl::array < tr2_colour_t > tr2_colour_array_t;
+
+void vt_bounds_vec4(const vt_vec4_t *in, bitu32 count, vt_vec4_t & min, vt_vec4_t & max);
+void vt_transform_vec4(const float *matrix, const vt_vec4_t *in, vt_vec4_t *out, bitu32 count);
+void vt_expand_vec4_16(const vt_vec4_16_t *in, const vt_vec4_t & origin, vt_vec4_t *out, bitu32 count);
+void vt_downsample_rgba8(const bitu32 *src, bitu32 size, bitu32 *dst);
+
+#endif // _VT_SIMD_H_